@@ -1,3 +1,4 @@
+import sys
 from pathlib import Path
 from setuptools import setup, glob
 from pybind11.setup_helpers import Pybind11Extension, build_ext
@@ -9,11 +10,15 @@ this_directory = Path(__file__).parent
 long_description = (this_directory / "README.md").read_text(encoding="utf-8")
 
 
+thread_flags = [] if sys.platform == "win32" else ["-pthread"]
+
 ext_modules = [
     Pybind11Extension(
         "whr_core",
         glob.glob("src/*.cc"),
         define_macros=[("VERSION_INFO", __version__)],
+        extra_compile_args=thread_flags,
+        extra_link_args=thread_flags,
     ),
 ]
 
@@ -0,0 +1,116 @@
+#include "whr.h"
+#include <cmath>
+
+namespace whr {
+
+void AndersonMixing::reset() {
+  delta_g_.clear();
+  delta_f_.clear();
+  last_g_.clear();
+  last_f_.clear();
+}
+
+bool AndersonMixing::extrapolate(const std::vector<double> &x,
+                                 const std::vector<double> &g,
+                                 std::vector<double> &res) {
+  size_t n = x.size();
+  if (last_g_.size() != n) {
+    reset();
+  }
+  std::vector<double> f(n, 0.);
+  for (size_t i = 0; i < n; i++) {
+    f[i] = g[i] - x[i];
+  }
+  if (!last_g_.empty()) {
+    std::vector<double> dg(n, 0.), df(n, 0.);
+    for (size_t i = 0; i < n; i++) {
+      dg[i] = g[i] - last_g_[i];
+      df[i] = f[i] - last_f_[i];
+    }
+    delta_g_.push_back(dg);
+    delta_f_.push_back(df);
+    if (delta_g_.size() > depth_) {
+      delta_g_.erase(delta_g_.begin());
+      delta_f_.erase(delta_f_.begin());
+    }
+  }
+  last_g_ = g;
+  last_f_ = f;
+
+  size_t m = delta_f_.size();
+  if (m == 0) {
+    return false;
+  }
+
+  // Least squares min |f - dF * gamma| via the normal equations, which are
+  // tiny (m <= depth) and slightly regularized to survive stagnated columns.
+  std::vector<double> a(m * m, 0.), rhs(m, 0.);
+  double trace = 0.;
+  for (size_t j = 0; j < m; j++) {
+    for (size_t k = j; k < m; k++) {
+      double dot = 0.;
+      for (size_t i = 0; i < n; i++) {
+        dot += delta_f_[j][i] * delta_f_[k][i];
+      }
+      a[j * m + k] = dot;
+      a[k * m + j] = dot;
+    }
+    for (size_t i = 0; i < n; i++) {
+      rhs[j] += delta_f_[j][i] * f[i];
+    }
+    trace += a[j * m + j];
+  }
+  if (!(trace > 0.)) {
+    return false;
+  }
+  for (size_t j = 0; j < m; j++) {
+    a[j * m + j] += 1e-10 * trace;
+  }
+  for (size_t col = 0; col < m; col++) {
+    size_t pivot = col;
+    for (size_t row = col + 1; row < m; row++) {
+      if (std::abs(a[row * m + col]) > std::abs(a[pivot * m + col])) {
+        pivot = row;
+      }
+    }
+    if (a[pivot * m + col] == 0.) {
+      return false;
+    }
+    if (pivot != col) {
+      for (size_t k = 0; k < m; k++) {
+        std::swap(a[col * m + k], a[pivot * m + k]);
+      }
+      std::swap(rhs[col], rhs[pivot]);
+    }
+    for (size_t row = col + 1; row < m; row++) {
+      double factor = a[row * m + col] / a[col * m + col];
+      for (size_t k = col; k < m; k++) {
+        a[row * m + k] -= factor * a[col * m + k];
+      }
+      rhs[row] -= factor * rhs[col];
+    }
+  }
+  std::vector<double> gamma(m, 0.);
+  for (int j = static_cast<int>(m) - 1; j >= 0; j--) {
+    double sum = rhs[j];
+    for (size_t k = j + 1; k < m; k++) {
+      sum -= a[j * m + k] * gamma[k];
+    }
+    gamma[j] = sum / a[j * m + j];
+  }
+
+  res = g;
+  for (size_t j = 0; j < m; j++) {
+    for (size_t i = 0; i < n; i++) {
+      res[i] -= gamma[j] * delta_g_[j][i];
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!std::isfinite(res[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace whr
@@ -1,11 +1,18 @@
 #include "whr.h"
 #include <algorithm>
+#include <cmath>
+#include <deque>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace whr {
-Base::Base(double w2, int virtual_games)
-    : w2_(w2), virtual_games_(virtual_games) {}
+Base::Base(double w2, int virtual_games, std::string precision)
+    : w2_(w2), virtual_games_(virtual_games),
+      precision_(parse_precision(precision)),
+      outcome_model_(OutcomeModel::WIN_LOSS), components_dirty_(true),
+      component_count_(0) {}
 
 void Base::print_ordered_ratings() const {
   std::vector<std::shared_ptr<Player>> players;
@@ -34,8 +41,24 @@ void Base::print_ordered_ratings() const {
   }
 }
 
-py::list Base::get_ordered_ratings() {
-  py::list res;
+void Base::export_ratings(std::string path, uint64_t chunk_rows) const {
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  std::vector<std::string> names;
+  names.reserve(players.size());
+  ColumnarWriter writer(path, chunk_rows);
+  for (size_t i = 0; i < players.size(); i++) {
+    names.push_back(players[i]->get_name());
+    for (const auto d : players[i]->get_days()) {
+      writer.append(static_cast<uint32_t>(i), d->get_time_step(), d->elo(),
+                    std::sqrt(d->get_uncertainty()) * 400. / std::log(10.));
+    }
+  }
+  writer.finish(names);
+}
+
+std::vector<std::pair<std::string, std::vector<RatingPoint>>>
+Base::get_ordered_ratings() {
+  std::vector<std::pair<std::string, std::vector<RatingPoint>>> res;
   std::vector<std::shared_ptr<Player>> players;
   for (auto player_it : players_) {
     if (player_it.second->get_days().size() > 0) {
@@ -48,14 +71,25 @@ py::list Base::get_ordered_ratings() {
         return p1->get_days().back()->gamma() > p2->get_days().back()->gamma();
       });
   for (const auto player : players) {
-    py::tuple player_ratings(2);
-    player_ratings[0] = player->get_name();
-    player_ratings[1] = ratings_for_player(player->get_name());
-    res.append(player_ratings);
+    res.emplace_back(player->get_name(),
+                     ratings_for_player(player->get_name()));
   }
   return res;
 }
 
+std::string Base::outcome_model() const {
+  switch (outcome_model_) {
+  case OutcomeModel::WIN_LOSS:
+    return "win_loss";
+  case OutcomeModel::WIN_DRAW_LOSS:
+    return "win_draw_loss";
+  case OutcomeModel::WIN_LOSS_HANDICAP:
+    return "win_loss_handicap";
+  default:
+    return "win_draw_loss_handicap";
+  }
+}
+
 double Base::log_likelihood() const {
   double score = 0.;
   for (const auto player_it : players_) {
@@ -67,29 +101,29 @@ double Base::log_likelihood() const {
 }
 
 std::shared_ptr<Player> Base::player_by_name(std::string name) {
-  if (players_.find(name) == players_.end()) {
-    players_[name] = std::make_shared<Player>(name, w2_, virtual_games_);
+  auto it = players_.find(name);
+  if (it == players_.end()) {
+    auto player = std::make_shared<Player>(name, w2_, virtual_games_,
+                                           precision_, outcome_model_);
+    it = players_.emplace(name, player).first;
     players_order_.push_back(name);
+    components_dirty_ = true;
   }
-  return players_[name];
+  return it->second;
 }
 
-py::list Base::ratings_for_player(std::string name) {
-  py::list res;
+std::vector<RatingPoint> Base::ratings_for_player(std::string name) {
+  std::vector<RatingPoint> res;
   auto player = player_by_name(name);
   for (const auto d : player->get_days()) {
-    py::list pd_info;
-    pd_info.append(d->get_time_step());
-    pd_info.append(d->elo());
-    pd_info.append(std::sqrt(d->get_uncertainty()) * 400. / std::log(10.));
-    res.append(pd_info);
+    res.emplace_back(d->get_time_step(), d->elo(),
+                     std::sqrt(d->get_uncertainty()) * 400. / std::log(10.));
   }
   return res;
 }
 
 std::shared_ptr<Game> Base::setup_game(std::string black, std::string white,
-                                       std::string winner, int time_step,
-                                       double handicap) {
+                                       int time_step, double handicap) {
   if (black == white) {
     std::cerr << "Game players cannot be equal: " << black << " and " << white
               << std::endl;
@@ -97,70 +131,754 @@ std::shared_ptr<Game> Base::setup_game(std::string black, std::string white,
   }
   std::shared_ptr<Player> white_player = player_by_name(white);
   std::shared_ptr<Player> black_player = player_by_name(black);
-  std::shared_ptr<Game> game = std::make_shared<Game>(
-      black_player, white_player, winner, time_step, handicap);
+  // Games between the same two player days with the same handicap share one
+  // weighted record.
+  GameKey key(white_player.get(), black_player.get(), time_step, handicap);
+  auto inserted = game_records_.emplace(key, nullptr);
+  if (!inserted.second) {
+    return inserted.first->second;
+  }
+  std::shared_ptr<Game> game =
+      std::make_shared<Game>(black_player, white_player, time_step, handicap);
+  inserted.first->second = game;
+  add_game(game);
   return game;
 }
 
-void Base::create_games(const py::list games) {
-  std::vector<py::list> games_list;
-  for (size_t i = 0; i < games.size(); i++) {
-    games_list.push_back(games[i]);
+void Base::create_games(const std::vector<GameRecord> &games, int threads) {
+  for (const GameRecord &game : games) {
+    if (!(game.black_wins >= 0. && game.white_wins >= 0. &&
+          game.draws >= 0.)) {
+      throw std::invalid_argument("Game results cannot be negative");
+    }
+  }
+  std::vector<size_t> order(games.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+    return games[i].time_step < games[j].time_step;
+  });
+  // Records are resolved serially in time order, exactly like create_game.
+  // New records are linked in bulk afterwards for players without days,
+  // whose per-player game lists are then already sorted by time step.
+  std::unordered_map<Player *, size_t> bulk_index;
+  std::vector<std::shared_ptr<Player>> bulk_players;
+  std::vector<std::vector<std::shared_ptr<Game>>> bulk_games;
+  std::vector<std::pair<std::shared_ptr<Player>, std::shared_ptr<Game>>>
+      linked_games;
+  bool draws = false, handicap = false;
+  for (size_t i : order) {
+    const GameRecord &record = games[i];
+    if (record.black_wins + record.white_wins + record.draws == 0.) {
+      continue;
+    }
+    if (record.black_player == record.white_player) {
+      std::cerr << "Game players cannot be equal: " << record.black_player
+                << " and " << record.white_player << std::endl;
+      continue;
+    }
+    std::shared_ptr<Player> white_player = player_by_name(record.white_player);
+    std::shared_ptr<Player> black_player = player_by_name(record.black_player);
+    GameKey key(white_player.get(), black_player.get(), record.time_step,
+                record.handicap);
+    auto inserted = game_records_.emplace(key, nullptr);
+    std::shared_ptr<Game> game = inserted.first->second;
+    if (!inserted.second) {
+      if (game->get_wpd() != nullptr) {
+        game->get_wpd()->clear_game_terms_cache();
+      }
+      if (game->get_bpd() != nullptr) {
+        game->get_bpd()->clear_game_terms_cache();
+      }
+    } else {
+      game = std::make_shared<Game>(black_player, white_player,
+                                    record.time_step, record.handicap);
+      inserted.first->second = game;
+      game->set_index(games_.size());
+      games_.push_back(game);
+      for (auto player : {white_player, black_player}) {
+        if (!player->get_days().empty()) {
+          linked_games.emplace_back(player, game);
+          continue;
+        }
+        auto index = bulk_index.emplace(player.get(), bulk_players.size());
+        if (index.second) {
+          bulk_players.push_back(player);
+          bulk_games.emplace_back();
+        }
+        bulk_games[index.first->second].push_back(game);
+      }
+    }
+    game->add_results(record.black_wins, record.white_wins, record.draws);
+    draws = draws || record.draws > 0.;
+    handicap = handicap || record.handicap != 0.;
+  }
+  parallel_for(bulk_players.size(), threads, [&](size_t i) {
+    bulk_players[i]->build_days(bulk_games[i]);
+  });
+  for (const auto &linked : linked_games) {
+    linked.first->add_game(linked.second);
+  }
+  components_dirty_ = true;
+  update_outcome_model(draws, handicap);
+}
+
+std::unordered_map<std::string, std::vector<RatingPoint>>
+Base::replay(const std::vector<GameRecord> &games) {
+  // Games already in the database would leak into the as-of ratings.
+  if (!games_.empty()) {
+    throw std::invalid_argument("Cannot replay into a non-empty database");
+  }
+  std::vector<size_t> order(games.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
   }
-  std::sort(games_list.begin(), games_list.end(),
-            [](const py::list g1, const py::list g2) { return g1[3] < g2[3]; });
-  for (const py::list game : games_list) {
-    std::string black = py::cast<std::string>(game[0]);
-    std::string white = py::cast<std::string>(game[1]);
-    std::string winner = py::cast<std::string>(game[2]);
-    int time_step = py::cast<int>(game[3]);
-    double handicap = 0.;
-    if (game.size() >= 5) {
-      handicap = py::cast<double>(game[4]);
+  std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+    return games[i].time_step < games[j].time_step;
+  });
+  std::unordered_map<std::string, std::vector<RatingPoint>> series;
+  std::vector<GameRecord> day_games;
+  for (size_t begin = 0; begin < order.size();) {
+    int time_step = games[order[begin]].time_step;
+    day_games.clear();
+    size_t end = begin;
+    for (; end < order.size() && games[order[end]].time_step == time_step;
+         end++) {
+      day_games.push_back(games[order[end]]);
+    }
+    begin = end;
+    // New days start from the previous day's rating, so only the region
+    // around today's players needs to be re-solved.
+    create_games(day_games, 1);
+    std::vector<std::shared_ptr<Player>> players;
+    std::unordered_set<Player *> seen;
+    for (const GameRecord &game : day_games) {
+      for (const std::string &name : {game.black_player, game.white_player}) {
+        auto it = players_.find(name);
+        if (it != players_.end() && !it->second->get_days().empty() &&
+            seen.insert(it->second.get()).second) {
+          players.push_back(it->second);
+        }
+      }
+    }
+    resolve_locally(players);
+    for (const auto &player : players) {
+      const auto &days = player->get_days();
+      auto it = std::lower_bound(
+          days.begin(), days.end(), time_step,
+          [](const std::shared_ptr<PlayerDay> &d, int t) {
+            return d->get_time_step() < t;
+          });
+      if (it != days.end() && (*it)->get_time_step() == time_step) {
+        series[player->get_name()].emplace_back(
+            time_step, (*it)->elo(),
+            std::sqrt((*it)->get_uncertainty()) * 400. / std::log(10.));
+      }
     }
-    create_game(black, white, winner, time_step, handicap);
   }
+  return series;
 }
 
 void Base::create_game(std::string black, std::string white, std::string winner,
                        int time_step, double handicap) {
-  std::shared_ptr<Game> game =
-      setup_game(black, white, winner, time_step, handicap);
+  double black_wins, white_wins, draws;
+  winner_results(winner, black_wins, white_wins, draws);
+  create_weighted_game(black, white, time_step, black_wins, white_wins, draws,
+                       handicap);
+}
+
+void Base::create_weighted_game(std::string black, std::string white,
+                                int time_step, double black_wins,
+                                double white_wins, double draws,
+                                double handicap) {
+  if (!(black_wins >= 0. && white_wins >= 0. && draws >= 0.)) {
+    throw std::invalid_argument("Game results cannot be negative");
+  }
+  if (black_wins + white_wins + draws == 0.) {
+    return;
+  }
+  std::shared_ptr<Game> game = setup_game(black, white, time_step, handicap);
   if (game != nullptr) {
-    add_game(game);
+    add_results(game, black_wins, white_wins, draws);
   }
 }
 
 void Base::add_game(const std::shared_ptr<Game> game) {
+  game->set_index(games_.size());
   games_.push_back(game);
+  components_dirty_ = true;
   game->get_white_player()->add_game(game);
   game->get_black_player()->add_game(game);
 }
 
-int Base::iterate_until_coverge(bool verbose) {
+void Base::add_results(const std::shared_ptr<Game> game, double black_wins,
+                       double white_wins, double draws) {
+  game->add_results(black_wins, white_wins, draws);
+  game->get_wpd()->clear_game_terms_cache();
+  game->get_bpd()->clear_game_terms_cache();
+  update_outcome_model(draws > 0., game->get_handicap() != 0.);
+}
+
+std::shared_ptr<Game> Base::find_game(std::string black, std::string white,
+                                      int time_step, double handicap) const {
+  auto white_it = players_.find(white);
+  auto black_it = players_.find(black);
+  if (white_it == players_.end() || black_it == players_.end()) {
+    return nullptr;
+  }
+  auto it = game_records_.find(GameKey(white_it->second.get(),
+                                       black_it->second.get(), time_step,
+                                       handicap));
+  if (it == game_records_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+// Result counts are sums of user-supplied doubles, so removals are matched
+// against them up to a tolerance, and counts left within it are cleared.
+const double RESULT_TOLERANCE = 1e-9;
+
+static bool has_results(const std::shared_ptr<Game> game, double black_wins,
+                        double white_wins, double draws) {
+  return game != nullptr &&
+         black_wins <= game->get_black_wins() + RESULT_TOLERANCE &&
+         white_wins <= game->get_white_wins() + RESULT_TOLERANCE &&
+         draws <= game->get_draws() + RESULT_TOLERANCE;
+}
+
+static double removed_count(double count, double removed) {
+  return count - removed <= RESULT_TOLERANCE ? count : removed;
+}
+
+void Base::remove_game(std::string black, std::string white,
+                       std::string winner, int time_step, double handicap,
+                       bool resolve) {
+  double black_wins, white_wins, draws;
+  winner_results(winner, black_wins, white_wins, draws);
+  remove_weighted_game(black, white, time_step, black_wins, white_wins, draws,
+                       handicap, resolve);
+}
+
+void Base::remove_weighted_game(std::string black, std::string white,
+                                int time_step, double black_wins,
+                                double white_wins, double draws,
+                                double handicap, bool resolve) {
+  if (!(black_wins >= 0. && white_wins >= 0. && draws >= 0.)) {
+    throw std::invalid_argument("Game results cannot be negative");
+  }
+  std::shared_ptr<Game> game = find_game(black, white, time_step, handicap);
+  if (!has_results(game, black_wins, white_wins, draws)) {
+    throw std::invalid_argument("No such game to remove: " + black + " vs " +
+                                white + " at " + std::to_string(time_step));
+  }
+  std::vector<std::shared_ptr<Player>> players = {game->get_black_player(),
+                                                  game->get_white_player()};
+  remove_results(game, black_wins, white_wins, draws);
+  if (resolve) {
+    resolve_locally(players);
+  }
+}
+
+void Base::update_game_result(std::string black, std::string white,
+                              std::string old_winner, std::string new_winner,
+                              int time_step, double handicap, bool resolve) {
+  double black_wins, white_wins, draws;
+  winner_results(old_winner, black_wins, white_wins, draws);
+  std::shared_ptr<Game> game = find_game(black, white, time_step, handicap);
+  if (!has_results(game, black_wins, white_wins, draws)) {
+    throw std::invalid_argument("No such game to update: " + black + " vs " +
+                                white + " at " + std::to_string(time_step));
+  }
+  std::vector<std::shared_ptr<Player>> players = {game->get_black_player(),
+                                                  game->get_white_player()};
+  // Adding the new result first keeps the record, and so both player days,
+  // alive through the correction.
+  create_game(black, white, new_winner, time_step, handicap);
+  remove_results(game, black_wins, white_wins, draws);
+  if (resolve) {
+    resolve_locally(players);
+  }
+}
+
+void Base::remove_results(const std::shared_ptr<Game> game, double black_wins,
+                          double white_wins, double draws) {
+  game->add_results(-removed_count(game->get_black_wins(), black_wins),
+                    -removed_count(game->get_white_wins(), white_wins),
+                    -removed_count(game->get_draws(), draws));
+  if (game->get_black_wins() + game->get_white_wins() + game->get_draws() <=
+      RESULT_TOLERANCE) {
+    unlink_game(game);
+  } else {
+    game->get_wpd()->clear_game_terms_cache();
+    game->get_bpd()->clear_game_terms_cache();
+  }
+  // The outcome model is never narrowed again; the wider kernels stay exact.
+}
+
+void Base::unlink_game(const std::shared_ptr<Game> game) {
+  game_records_.erase(GameKey(game->get_white_player().get(),
+                              game->get_black_player().get(),
+                              game->get_time_step(), game->get_handicap()));
+  size_t index = game->get_index();
+  games_[index] = games_.back();
+  games_[index]->set_index(index);
+  games_.pop_back();
+  game->get_white_player()->remove_game(game);
+  game->get_black_player()->remove_game(game);
+  components_dirty_ = true;
+}
+
+int Base::resolve_locally(const std::vector<std::shared_ptr<Player>> &players) {
+  // Newton updates spread from the given players through their opponents
+  // until no rating moves by more than the tolerance, which is the same
+  // centi-Elo resolution iterate_until_converge stops at.
+  const double tolerance = 0.01;
+  const size_t max_updates = 100 * (players_.size() + 1);
+  std::deque<std::shared_ptr<Player>> queue;
+  std::unordered_set<Player *> queued, touched;
+  std::vector<std::shared_ptr<Player>> touched_players;
+  for (auto player : players) {
+    if (queued.insert(player.get()).second) {
+      queue.push_back(player);
+    }
+  }
+  size_t updates = 0;
+  std::vector<double> last_ratings;
+  while (!queue.empty() && updates < max_updates) {
+    std::shared_ptr<Player> player = queue.front();
+    queue.pop_front();
+    queued.erase(player.get());
+    if (touched.insert(player.get()).second) {
+      touched_players.push_back(player);
+    }
+    last_ratings.clear();
+    for (const auto day : player->get_days()) {
+      last_ratings.push_back(day->elo());
+    }
+    player->run_one_newton_iteration();
+    updates++;
+    double delta = 0.;
+    for (size_t i = 0; i < last_ratings.size(); i++) {
+      double elo = player->get_days()[i]->elo();
+      delta = std::max(delta, std::abs(elo - last_ratings[i]));
+    }
+    if (delta <= tolerance) {
+      continue;
+    }
+    for (const auto day : player->get_days()) {
+      for (const auto game : day->get_games()) {
+        std::shared_ptr<Player> opponent = game->opponent(player);
+        if (queued.insert(opponent.get()).second) {
+          queue.push_back(opponent);
+        }
+      }
+    }
+  }
+  for (auto player : touched_players) {
+    player->update_uncertainty();
+  }
+  publish_snapshot();
+  return static_cast<int>(updates);
+}
+
+// Max-heap of player indices keyed on their gradient norms, with the
+// position of every player kept so that a changed norm is sifted in place.
+class NormHeap {
+  const std::vector<double> &norms_;
+  std::vector<size_t> heap_;
+  std::vector<size_t> positions_;
+  bool before(size_t a, size_t b) const {
+    return norms_[a] > norms_[b] || (norms_[a] == norms_[b] && a < b);
+  }
+  void swap(size_t p, size_t q) {
+    std::swap(heap_[p], heap_[q]);
+    positions_[heap_[p]] = p;
+    positions_[heap_[q]] = q;
+  }
+
+public:
+  NormHeap(const std::vector<double> &norms)
+      : norms_(norms), heap_(norms.size()), positions_(norms.size()) {
+    for (size_t i = 0; i < norms.size(); i++) {
+      heap_[i] = positions_[i] = i;
+    }
+    for (size_t p = norms.size() / 2; p-- > 0;) {
+      update(heap_[p]);
+    }
+  }
+  bool empty() const { return heap_.empty(); }
+  size_t top() const { return heap_[0]; }
+  void update(size_t i) {
+    size_t p = positions_[i];
+    while (p > 0 && before(heap_[p], heap_[(p - 1) / 2])) {
+      swap(p, (p - 1) / 2);
+      p = (p - 1) / 2;
+    }
+    while (true) {
+      size_t child = 2 * p + 1;
+      if (child >= heap_.size()) {
+        break;
+      }
+      if (child + 1 < heap_.size() && before(heap_[child + 1], heap_[child])) {
+        child++;
+      }
+      if (!before(heap_[child], heap_[p])) {
+        break;
+      }
+      swap(p, child);
+      p = child;
+    }
+  }
+};
+
+int Base::iterate_prioritized(int max_updates, double tolerance) {
+  // Southwell scheduling: the player with the largest gradient norm is
+  // updated next. A game adds w * p * (1 - p) to the derivative of one
+  // player's gradient by the other player's rating, so after an update the
+  // opponents' gradients are corrected to first order in O(1) per game
+  // instead of being recomputed; the updated player's own gradient is
+  // recomputed exactly.
+  struct Edge {
+    size_t day;
+    size_t opponent;
+    size_t opponent_day;
+    double weight;
+    double advantage;
+  };
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  std::unordered_map<Player *, size_t> indices;
+  std::unordered_map<PlayerDay *, size_t> day_indices;
+  for (size_t i = 0; i < players.size(); i++) {
+    indices[players[i].get()] = i;
+    const auto &days = players[i]->get_days();
+    for (size_t k = 0; k < days.size(); k++) {
+      day_indices[days[k].get()] = k;
+    }
+  }
+  // The game graph is flattened up front so that the corrections need no
+  // lookups: one edge per game and side, from a day to the opponent's day.
+  std::vector<std::vector<Edge>> edges(players.size());
+  for (size_t i = 0; i < players.size(); i++) {
+    const auto &days = players[i]->get_days();
+    for (size_t k = 0; k < days.size(); k++) {
+      for (const auto &game : days[k]->get_games()) {
+        bool white = game->get_white_player() == players[i];
+        const auto &day = white ? game->get_bpd() : game->get_wpd();
+        // The handicap as seen by the opponent, in natural rating units.
+        double advantage = (white ? -1. : 1.) * game->get_handicap() *
+                           std::log(10.) / 400.;
+        edges[i].push_back({k, indices.at(game->opponent(players[i]).get()),
+                            day_indices.at(day.get()),
+                            game->get_black_wins() + game->get_white_wins() +
+                                game->get_draws(),
+                            advantage});
+      }
+    }
+  }
+  std::vector<std::vector<double>> gradients(players.size());
+  std::vector<double> squared_norms(players.size(), 0.);
+  std::vector<double> norms(players.size(), 0.);
+  auto refresh = [&](size_t i) {
+    players[i]->current_gradient(gradients[i]);
+    squared_norms[i] = 0.;
+    for (double g : gradients[i]) {
+      squared_norms[i] += g * g;
+    }
+    norms[i] = std::sqrt(squared_norms[i]);
+  };
+  for (size_t i = 0; i < players.size(); i++) {
+    refresh(i);
+  }
+  NormHeap heap(norms);
+  std::vector<bool> touched(players.size(), false);
+  std::vector<double> last_r;
+  int updates = 0;
+  while (updates < max_updates && !heap.empty() &&
+         norms[heap.top()] > tolerance) {
+    size_t i = heap.top();
+    const auto &days = players[i]->get_days();
+    last_r.clear();
+    for (const auto day : days) {
+      last_r.push_back(day->get_r());
+    }
+    players[i]->run_one_newton_iteration();
+    touched[i] = true;
+    updates++;
+    for (const Edge &edge : edges[i]) {
+      size_t j = edge.opponent;
+      double delta = days[edge.day]->get_r() - last_r[edge.day];
+      double p = 1. / (1. + std::exp(days[edge.day]->get_r() + edge.advantage -
+                                     players[j]->get_days()[edge.opponent_day]
+                                         ->get_r()));
+      double &g = gradients[j][edge.opponent_day];
+      squared_norms[j] -= g * g;
+      g += edge.weight * p * (1. - p) * delta;
+      squared_norms[j] += g * g;
+      norms[j] = std::sqrt(std::max(squared_norms[j], 0.));
+      heap.update(j);
+    }
+    refresh(i);
+    heap.update(i);
+  }
+  for (size_t i = 0; i < players.size(); i++) {
+    if (touched[i]) {
+      players[i]->update_uncertainty();
+    }
+  }
+  publish_snapshot();
+  return updates;
+}
+
+void Base::update_outcome_model(bool new_draws, bool new_handicap) {
+  bool draws = outcome_model_ == OutcomeModel::WIN_DRAW_LOSS ||
+               outcome_model_ == OutcomeModel::WIN_DRAW_LOSS_HANDICAP;
+  bool handicap = outcome_model_ == OutcomeModel::WIN_LOSS_HANDICAP ||
+                  outcome_model_ == OutcomeModel::WIN_DRAW_LOSS_HANDICAP;
+  if ((new_draws && !draws) || (new_handicap && !handicap)) {
+    draws = draws || new_draws;
+    handicap = handicap || new_handicap;
+    if (draws) {
+      outcome_model_ = handicap ? OutcomeModel::WIN_DRAW_LOSS_HANDICAP
+                                : OutcomeModel::WIN_DRAW_LOSS;
+    } else {
+      outcome_model_ = OutcomeModel::WIN_LOSS_HANDICAP;
+    }
+    // Term caches built by the narrower kernels skip draws or handicaps.
+    for (auto player_it : players_) {
+      player_it.second->set_outcome_model(outcome_model_);
+      player_it.second->clear_game_terms_cache();
+    }
+  }
+}
+
+int Base::iterate_until_coverge(bool verbose, std::string acceleration,
+                                double omega) {
+  Acceleration mode = parse_acceleration(acceleration);
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  int count = converge_players(players, verbose, mode, omega,
+                               [this]() { publish_snapshot(); });
+  for (auto player : players) {
+    player->update_uncertainty();
+  }
+  publish_snapshot();
+  return count;
+}
+
+int Base::iterate_components_until_converge(int threads,
+                                            std::string acceleration,
+                                            double omega) {
+  Acceleration mode = parse_acceleration(acceleration);
+  compute_components();
+  std::vector<std::vector<std::shared_ptr<Player>>> components(
+      component_count_);
+  for (auto player : sorted_players()) {
+    components[player->get_component()].push_back(player);
+  }
+  std::sort(components.begin(), components.end(),
+            [](const std::vector<std::shared_ptr<Player>> &c1,
+               const std::vector<std::shared_ptr<Player>> &c2) {
+              return c1.size() > c2.size();
+            });
+  std::vector<int> counts(components.size(), 0);
+  parallel_for(components.size(), threads, [&](size_t i) {
+    counts[i] = converge_players(components[i], false, mode, omega);
+    for (auto player : components[i]) {
+      player->update_uncertainty();
+    }
+  });
+  publish_snapshot();
+  int count = 0;
+  for (int c : counts) {
+    count = std::max(count, c);
+  }
+  return count;
+}
+
+void Base::iterate(int count, std::string acceleration, double omega) {
+  Acceleration mode = parse_acceleration(acceleration);
+  AndersonMixing mixing;
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  for (int i = 0; i < count; i++) {
+    run_one_iteration(players, mode, omega, mixing);
+    publish_snapshot();
+  }
+  for (auto player : players) {
+    player->update_uncertainty();
+  }
+  publish_snapshot();
+}
+
+int Base::iterate_multilevel(std::vector<int> bucket_sizes, bool verbose,
+                             std::string acceleration, double omega) {
+  for (int bucket_size : bucket_sizes) {
+    if (bucket_size < 1) {
+      throw std::invalid_argument("Bucket sizes must be positive");
+    }
+  }
+  Acceleration mode = parse_acceleration(acceleration);
+  // Coarsest level first; each level starts from the one above it.
+  std::sort(bucket_sizes.begin(), bucket_sizes.end(), std::greater<int>());
+  bucket_sizes.erase(std::unique(bucket_sizes.begin(), bucket_sizes.end()),
+                     bucket_sizes.end());
+  std::unique_ptr<Base> coarse;
+  int coarse_bucket_size = 1;
+  for (int bucket_size : bucket_sizes) {
+    if (bucket_size == 1) {
+      continue;
+    }
+    std::unique_ptr<Base> level = coarsened(bucket_size);
+    if (coarse) {
+      level->warm_start(*coarse, bucket_size, coarse_bucket_size);
+    }
+    int count = level->converge_coarse(mode, omega);
+    if (verbose) {
+      std::cout << "Level: " << bucket_size << ", players: "
+                << level->players_.size() << ", games: "
+                << level->games_.size() << ", iterations: " << count
+                << std::endl;
+    }
+    coarse = std::move(level);
+    coarse_bucket_size = bucket_size;
+  }
+  if (coarse) {
+    warm_start(*coarse, 1, coarse_bucket_size);
+  }
+  return iterate_until_coverge(verbose, acceleration, omega);
+}
+
+int Base::converge_coarse(Acceleration acceleration, double omega) {
+  // A coarse level only seeds the next one, so it stops as soon as no
+  // rating moves by more than 0.001 Elo in a round instead of waiting out
+  // the ten quiet rounds of iterate_until_converge.
+  const double tolerance = 0.001 * std::log(10.) / 400.;
+  const int max_iterations = 1000;
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  AndersonMixing mixing;
+  std::vector<double> before, after;
+  int count = 0;
+  while (count < max_iterations) {
+    collect_r(players, before);
+    run_one_iteration(players, acceleration, omega, mixing);
+    count++;
+    collect_r(players, after);
+    double delta = 0.;
+    for (size_t i = 0; i < after.size(); i++) {
+      delta = std::max(delta, std::abs(after[i] - before[i]));
+    }
+    if (delta <= tolerance) {
+      break;
+    }
+  }
+  return count;
+}
+
+static int bucket_of(int time_step, int bucket_size) {
+  // Floor division, so negative time steps bucket consistently.
+  return time_step >= 0 ? time_step / bucket_size
+                        : -((bucket_size - 1 - time_step) / bucket_size);
+}
+
+static double bucket_centre(int bucket, int bucket_size) {
+  return static_cast<double>(bucket) * bucket_size + (bucket_size - 1) / 2.;
+}
+
+std::unique_ptr<Base> Base::coarsened(int bucket_size) const {
+  // Merging bucket_size time steps into one keeps the rating drift between
+  // buckets by scaling the per-step variance w2 with the bucket size.
+  std::unique_ptr<Base> coarse(new Base(w2_ * bucket_size, virtual_games_));
+  coarse->precision_ = precision_;
+  std::vector<GameRecord> records;
+  records.reserve(games_.size());
+  for (const auto &game : games_) {
+    records.emplace_back(game->get_black_player()->get_name(),
+                         game->get_white_player()->get_name(),
+                         bucket_of(game->get_time_step(), bucket_size),
+                         game->get_black_wins(), game->get_white_wins(),
+                         game->get_draws(), game->get_handicap());
+  }
+  coarse->create_games(records);
+  return coarse;
+}
+
+void Base::warm_start(const Base &coarse, int bucket_size,
+                      int coarse_bucket_size) {
+  // Every day starts from the coarse ratings linearly interpolated between
+  // the bucket centres, clamped at the first and last bucket.
+  for (auto player_it : players_) {
+    auto coarse_it = coarse.players_.find(player_it.first);
+    if (coarse_it == coarse.players_.end() ||
+        coarse_it->second->get_days().empty()) {
+      continue;
+    }
+    const auto &coarse_days = coarse_it->second->get_days();
+    size_t j = 0;
+    for (auto day : player_it.second->get_days()) {
+      double t = bucket_centre(day->get_time_step(), bucket_size);
+      while (j + 1 < coarse_days.size() &&
+             bucket_centre(coarse_days[j + 1]->get_time_step(),
+                           coarse_bucket_size) <= t) {
+        j++;
+      }
+      double t0 =
+          bucket_centre(coarse_days[j]->get_time_step(), coarse_bucket_size);
+      double r = coarse_days[j]->get_r();
+      if (t > t0 && j + 1 < coarse_days.size()) {
+        double t1 = bucket_centre(coarse_days[j + 1]->get_time_step(),
+                                  coarse_bucket_size);
+        r += (t - t0) / (t1 - t0) * (coarse_days[j + 1]->get_r() - r);
+      }
+      day->set_r(r);
+    }
+  }
+}
+
+std::vector<std::shared_ptr<Player>> Base::sorted_players() const {
+  std::vector<std::string> sorted_player_names = players_order_;
+  std::sort(sorted_player_names.begin(), sorted_player_names.end());
+  std::vector<std::shared_ptr<Player>> players;
+  players.reserve(sorted_player_names.size());
+  for (const std::string &name : sorted_player_names) {
+    players.push_back(players_.at(name));
+  }
+  return players;
+}
+
+int Base::converge_players(const std::vector<std::shared_ptr<Player>> &players,
+                           bool verbose, Acceleration acceleration,
+                           double omega,
+                           const std::function<void()> &on_iteration) {
+  AndersonMixing mixing;
   int count = 0;
-  std::vector<int> ratings, last_ratings;
+  std::vector<double> ratings, last_ratings;
   int best_iteration;
-  std::vector<std::pair<std::string, std::shared_ptr<Player>>> sorted_players;
-  sorted_players.reserve(players_.size());
-  std::copy(players_.begin(), players_.end(),
-            std::back_inserter(sorted_players));
-  std::sort(sorted_players.begin(), sorted_players.end(),
-            [](const std::pair<std::string, std::shared_ptr<Player>> &p1,
-               const std::pair<std::string, std::shared_ptr<Player>> &p2) {
-              return p1.first < p2.first;
-            });
+  // Float32 Newton steps keep jittering around the optimum and would flip
+  // the rounded centi-Elo ratings forever. There, ratings are instead
+  // compared with those of the last round that moved one by at least
+  // FLOAT32_TOLERANCE Elo, well above the jitter; a slow drift then adds up
+  // over the rounds until it counts as a move.
+  const double FLOAT32_TOLERANCE = 1e-3;
+  bool float32 = !players.empty() &&
+                 players.front()->get_precision() == Precision::FLOAT32;
   while (true) {
     ratings.clear();
-    for (const auto &player : sorted_players) {
-      for (const auto day : player.second->get_days()) {
-        ratings.push_back(static_cast<int>(std::round(day->elo() * 100.)));
+    for (const auto &player : players) {
+      for (const auto day : player->get_days()) {
+        ratings.push_back(day->elo());
       }
     }
     int delta = 0;
     if (count > 0) {
       for (size_t i = 0; i < ratings.size(); i++) {
-        delta += std::abs(ratings[i] - last_ratings[i]);
+        if (float32) {
+          delta += std::abs(ratings[i] - last_ratings[i]) >= FLOAT32_TOLERANCE;
+        } else {
+          int rating = static_cast<int>(std::round(ratings[i] * 100.));
+          int last_rating =
+              static_cast<int>(std::round(last_ratings[i] * 100.));
+          delta += std::abs(rating - last_rating);
+        }
       }
       if (verbose) {
         std::cout << "Iteration: " << count << ", delta: " << delta
@@ -175,35 +893,178 @@ int Base::iterate_until_coverge(bool verbose) {
     } else {
       best_iteration = count;
     }
-    last_ratings = ratings;
-    run_one_iteration();
+    if (!float32 || best_iteration == count) {
+      last_ratings = ratings;
+    }
+    run_one_iteration(players, acceleration, omega, mixing);
+    if (on_iteration) {
+      on_iteration();
+    }
     count++;
   }
-  std::vector<std::string> sorted_player_names = players_order_;
-  std::sort(sorted_player_names.begin(), sorted_player_names.end());
-  for (const std::string &name : sorted_player_names) {
-    players_[name]->update_uncertainty();
-  }
   return count;
 }
 
-void Base::iterate(int count) {
-  for (int i = 0; i < count; i++) {
-    run_one_iteration();
+void Base::run_one_iteration(
+    const std::vector<std::shared_ptr<Player>> &players, double omega) {
+  for (auto player : players) {
+    player->run_one_newton_iteration(omega);
   }
-  std::vector<std::string> sorted_player_names = players_order_;
-  std::sort(sorted_player_names.begin(), sorted_player_names.end());
-  for (const std::string &name : sorted_player_names) {
-    players_[name]->update_uncertainty();
+}
+
+void Base::run_one_iteration(
+    const std::vector<std::shared_ptr<Player>> &players,
+    Acceleration acceleration, double omega, AndersonMixing &mixing) {
+  switch (acceleration) {
+  case Acceleration::SOR:
+    run_one_iteration(players, omega);
+    break;
+  case Acceleration::ANDERSON: {
+    std::vector<double> x, g, extrapolated;
+    collect_r(players, x);
+    run_one_iteration(players, omega);
+    collect_r(players, g);
+    if (mixing.extrapolate(x, g, extrapolated)) {
+      // Keep the extrapolated point only if it does not lose likelihood
+      // against the plain sweep; otherwise fall back and restart mixing.
+      double plain_likelihood = refreshed_log_likelihood(players);
+      assign_r(players, extrapolated);
+      double mixed_likelihood = refreshed_log_likelihood(players);
+      if (!(mixed_likelihood >= plain_likelihood)) {
+        assign_r(players, g);
+        mixing.reset();
+      }
+    }
+    break;
+  }
+  default:
+    run_one_iteration(players);
+    break;
+  }
+}
+
+void Base::collect_r(const std::vector<std::shared_ptr<Player>> &players,
+                     std::vector<double> &res) {
+  res.clear();
+  for (const auto &player : players) {
+    for (const auto day : player->get_days()) {
+      res.push_back(day->get_r());
+    }
+  }
+}
+
+void Base::assign_r(const std::vector<std::shared_ptr<Player>> &players,
+                    const std::vector<double> &r) {
+  size_t i = 0;
+  for (const auto &player : players) {
+    for (auto day : player->get_days()) {
+      day->set_r(r[i++]);
+    }
   }
 }
 
-void Base::run_one_iteration() {
-  std::vector<std::string> sorted_players = players_order_;
-  std::sort(sorted_players.begin(), sorted_players.end());
-  for (const std::string &name : sorted_players) {
-    players_[name]->run_one_newton_iteration();
+double Base::refreshed_log_likelihood(
+    const std::vector<std::shared_ptr<Player>> &players) {
+  double score = 0.;
+  for (const auto &player : players) {
+    if (player->get_days().size() > 0) {
+      player->clear_game_terms_cache();
+      score += player->log_likelihood();
+    }
+  }
+  return score;
+}
+
+void Base::compute_components() {
+  if (!components_dirty_) {
+    return;
+  }
+  std::vector<std::shared_ptr<Player>> players = sorted_players();
+  std::unordered_map<const Player *, size_t> index;
+  for (size_t i = 0; i < players.size(); i++) {
+    index[players[i].get()] = i;
+  }
+  std::vector<size_t> parent(players.size());
+  for (size_t i = 0; i < parent.size(); i++) {
+    parent[i] = i;
+  }
+  auto find = [&parent](size_t i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  for (const auto &game : games_) {
+    size_t white = find(index[game->get_white_player().get()]);
+    size_t black = find(index[game->get_black_player().get()]);
+    if (white != black) {
+      parent[std::max(white, black)] = std::min(white, black);
+    }
+  }
+  // Roots are the alphabetically first member of each component, so ids are
+  // numbered in order of each component's first player name.
+  std::vector<int> ids(players.size(), -1);
+  component_count_ = 0;
+  for (size_t i = 0; i < players.size(); i++) {
+    size_t root = find(i);
+    if (ids[root] < 0) {
+      ids[root] = component_count_++;
+    }
+    players[i]->set_component(ids[root]);
+  }
+  components_dirty_ = false;
+}
+
+int Base::component_for_player(std::string name) {
+  if (players_.find(name) == players_.end()) {
+    return -1;
+  }
+  compute_components();
+  return players_[name]->get_component();
+}
+
+std::shared_ptr<RatingSnapshots> Base::snapshot_reader() {
+  if (!snapshots_) {
+    snapshots_ = std::make_shared<RatingSnapshots>();
+    publish_snapshot();
+  }
+  return snapshots_;
+}
+
+void Base::publish_snapshot() {
+  // Publishing costs a pass over every player day, so it only starts once
+  // somebody asked for a reader.
+  if (snapshots_) {
+    snapshots_->publish(players_);
+  }
+}
+
+Acceleration Base::parse_acceleration(std::string acceleration) {
+  if (acceleration == "none") {
+    return Acceleration::NONE;
+  } else if (acceleration == "sor") {
+    return Acceleration::SOR;
+  } else if (acceleration == "anderson") {
+    return Acceleration::ANDERSON;
+  }
+  throw std::invalid_argument("Unknown acceleration: " + acceleration);
+}
+
+void Base::winner_results(std::string winner, double &black_wins,
+                          double &white_wins, double &draws) {
+  black_wins = winner == "B" ? 1. : 0.;
+  white_wins = winner == "W" ? 1. : 0.;
+  draws = 1. - black_wins - white_wins;
+}
+
+Precision Base::parse_precision(std::string precision) {
+  if (precision == "float64") {
+    return Precision::FLOAT64;
+  } else if (precision == "float32") {
+    return Precision::FLOAT32;
   }
+  throw std::invalid_argument("Unknown precision: " + precision);
 }
 
 } // namespace whr
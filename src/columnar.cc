@@ -0,0 +1,89 @@
+#include "whr.h"
+#include <stdexcept>
+
+namespace whr {
+
+static const char COLUMNAR_MAGIC[8] = {'W', 'H', 'R', 'C', 'O', 'L', '0', '1'};
+static const char PADDING[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+ColumnarWriter::ColumnarWriter(const std::string &path, uint64_t chunk_rows)
+    : out_(path, std::ios::binary | std::ios::trunc),
+      chunk_rows_(chunk_rows > 0 ? chunk_rows : 1), rows_(0) {
+  if (!out_) {
+    throw std::runtime_error("Cannot open " + path + " for writing");
+  }
+  players_.reserve(chunk_rows_);
+  time_steps_.reserve(chunk_rows_);
+  elos_.reserve(chunk_rows_);
+  stddevs_.reserve(chunk_rows_);
+  uint32_t version = 1, reserved = 0;
+  write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+  write(&version, sizeof(version));
+  write(&reserved, sizeof(reserved));
+  write(&chunk_rows_, sizeof(chunk_rows_));
+}
+
+void ColumnarWriter::write(const void *data, size_t bytes) {
+  out_.write(static_cast<const char *>(data), bytes);
+  // Every section starts on an 8-byte boundary so the columns can be
+  // memory-mapped as typed arrays.
+  size_t padding = (8 - bytes % 8) % 8;
+  out_.write(PADDING, padding);
+  if (!out_) {
+    throw std::runtime_error("Cannot write columnar ratings");
+  }
+}
+
+void ColumnarWriter::append(uint32_t player, int32_t time_step, double elo,
+                            double stddev) {
+  players_.push_back(player);
+  time_steps_.push_back(time_step);
+  elos_.push_back(elo);
+  stddevs_.push_back(stddev);
+  if (players_.size() >= chunk_rows_) {
+    flush_chunk();
+  }
+}
+
+void ColumnarWriter::flush_chunk() {
+  uint64_t rows = players_.size();
+  if (rows == 0) {
+    return;
+  }
+  chunk_offsets_.push_back(static_cast<uint64_t>(out_.tellp()));
+  write(&rows, sizeof(rows));
+  write(players_.data(), rows * sizeof(uint32_t));
+  write(time_steps_.data(), rows * sizeof(int32_t));
+  write(elos_.data(), rows * sizeof(double));
+  write(stddevs_.data(), rows * sizeof(double));
+  rows_ += rows;
+  players_.clear();
+  time_steps_.clear();
+  elos_.clear();
+  stddevs_.clear();
+}
+
+void ColumnarWriter::finish(const std::vector<std::string> &names) {
+  flush_chunk();
+  uint64_t dictionary_offset = static_cast<uint64_t>(out_.tellp());
+  for (const std::string &name : names) {
+    uint32_t length = static_cast<uint32_t>(name.size());
+    out_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    out_.write(name.data(), name.size());
+  }
+  size_t bytes = static_cast<uint64_t>(out_.tellp()) - dictionary_offset;
+  out_.write(PADDING, (8 - bytes % 8) % 8);
+  uint64_t index_offset = static_cast<uint64_t>(out_.tellp());
+  write(chunk_offsets_.data(), chunk_offsets_.size() * sizeof(uint64_t));
+  uint64_t footer[5] = {dictionary_offset, index_offset,
+                        static_cast<uint64_t>(chunk_offsets_.size()), rows_,
+                        static_cast<uint64_t>(names.size())};
+  write(footer, sizeof(footer));
+  write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+  out_.close();
+  if (!out_) {
+    throw std::runtime_error("Cannot write columnar ratings");
+  }
+}
+
+} // namespace whr
@@ -6,21 +6,33 @@
 namespace whr {
 
 Game::Game(const std::shared_ptr<Player> black,
-           const std::shared_ptr<Player> white, std::string winner,
-           int time_step, double handicap)
+           const std::shared_ptr<Player> white, int time_step,
+           double handicap)
     : white_player_(white), black_player_(black), time_step_(time_step),
-      handicap_(handicap) {
-  if (winner == "W") {
-    winner_ = Winner::WHITE;
-  } else if (winner == "B") {
-    winner_ = Winner::BLACK;
-  } else {
-    winner_ = Winner::DRAW;
-  }
+      black_wins_(0.), white_wins_(0.), draws_(0.), handicap_(handicap),
+      index_(0) {}
+
+void Game::add_results(double black_wins, double white_wins, double draws) {
+  black_wins_ += black_wins;
+  white_wins_ += white_wins;
+  draws_ += draws;
+}
+
+double Game::won_weight(const std::shared_ptr<Player> &player) const {
+  return player == white_player_ ? white_wins_ : black_wins_;
 }
 
+double Game::lost_weight(const std::shared_ptr<Player> &player) const {
+  return player == white_player_ ? black_wins_ : white_wins_;
+}
+
+template <bool Handicap>
 double
-Game::opponents_adjusted_gamma(const std::shared_ptr<Player> player) const {
+Game::opponents_adjusted_gamma(const std::shared_ptr<Player> &player) const {
+  if (!Handicap) {
+    // Without handicaps the adjusted gamma is just the opponent's own gamma.
+    return player == white_player_ ? bpd_->gamma() : wpd_->gamma();
+  }
   double black_advantage = handicap_;
   double opponent_elo;
   double rval = 0.;
@@ -35,7 +47,13 @@ Game::opponents_adjusted_gamma(const std::shared_ptr<Player> player) const {
   return rval;
 }
 
-std::shared_ptr<Player> Game::opponent(const std::shared_ptr<Player> player) {
+template double Game::opponents_adjusted_gamma<false>(
+    const std::shared_ptr<Player> &player) const;
+template double Game::opponents_adjusted_gamma<true>(
+    const std::shared_ptr<Player> &player) const;
+
+std::shared_ptr<Player>
+Game::opponent(const std::shared_ptr<Player> player) const {
   if (player == white_player_) {
     return black_player_;
   } else {
@@ -45,24 +63,21 @@ std::shared_ptr<Player> Game::opponent(const std::shared_ptr<Player> player) {
 
 std::string Game::inspect() {
   char buffer[1000];
-  std::snprintf(
-      buffer, 1000, "Game: W:%s(%.2f) B:%s(%.2f) winner = %s, handicap = %.2f",
-      white_player_->get_name().c_str(), wpd_ ? wpd_->get_r() : 0.,
-      black_player_->get_name().c_str(), bpd_ ? bpd_->get_r() : 0.,
-      winner_ == Winner::WHITE ? "W" : (winner_ == Winner::BLACK ? "B" : "D"),
-      handicap_);
+  std::snprintf(buffer, 1000,
+                "Game: W:%s(%.2f) B:%s(%.2f) results = W %.2f / B %.2f / D "
+                "%.2f, handicap = %.2f",
+                white_player_->get_name().c_str(), wpd_ ? wpd_->get_r() : 0.,
+                black_player_->get_name().c_str(), bpd_ ? bpd_->get_r() : 0.,
+                white_wins_, black_wins_, draws_, handicap_);
   return std::string(buffer);
 }
 
 double Game::likelihood() {
-  switch (winner_) {
-  case Winner::WHITE:
-    return white_win_probability();
-  case Winner::BLACK:
-    return black_win_probability();
-  default:
-    return std::sqrt(white_win_probability() * black_win_probability());
-  }
+  double white_probability = white_win_probability();
+  double black_probability = black_win_probability();
+  return std::pow(white_probability, white_wins_) *
+         std::pow(black_probability, black_wins_) *
+         std::pow(white_probability * black_probability, 0.5 * draws_);
 }
 
 double Game::white_win_probability() {
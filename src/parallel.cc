@@ -0,0 +1,61 @@
+#include "whr.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace whr {
+
+static thread_local bool parallel_worker = false;
+
+bool in_parallel_for() { return parallel_worker; }
+
+void parallel_for(size_t count, int threads,
+                  const std::function<void(size_t)> &fn) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  size_t workers = std::min(static_cast<size_t>(std::max(threads, 1)), count);
+  if (workers <= 1 || parallel_worker) {
+    for (size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto work = [&]() {
+    bool was_worker = parallel_worker;
+    parallel_worker = true;
+    while (true) {
+      size_t i = next++;
+      if (i >= count) {
+        break;
+      }
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = count;
+      }
+    }
+    parallel_worker = was_worker;
+  };
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < workers; i++) {
+    pool.emplace_back(work);
+  }
+  work();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace whr
@@ -1,13 +1,16 @@
 #include "whr.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <iostream>
 
 namespace whr {
 
-Player::Player(std::string name, double w2, int virtual_games)
+Player::Player(std::string name, double w2, int virtual_games,
+               Precision precision, OutcomeModel outcome_model)
     : name_(name), w2_(w2 * std::pow((std::log(10.) / 400.), 2)),
-      virtual_games_(virtual_games) {}
+      virtual_games_(virtual_games), precision_(precision),
+      outcome_model_(outcome_model), component_(-1) {}
 
 std::string Player::inspect() const {
   char buffer[1000];
@@ -43,153 +46,146 @@ double Player::log_likelihood() const {
   return sum;
 }
 
-void Player::hessian(const std::vector<double> &sigma2,
-                     std::vector<double> &res) const {
+template <typename Scalar, typename Model>
+void Player::hessian(const std::vector<Scalar> &sigma2,
+                     std::vector<Scalar> &diagonal,
+                     std::vector<Scalar> &off_diagonal, int blocks) const {
   size_t n = days_.size();
-  res = std::vector<double>(n * n, 0.);
-  for (size_t row = 0; row < n; row++) {
-    for (size_t col = 0; col < n; col++) {
-      if (row == col) {
-        double prior = 0.;
-        if (row < n - 1) {
-          prior += -1. / sigma2[row];
-        }
-        if (row > 0) {
-          prior += -1. / sigma2[row - 1];
-        }
-        res[row * n + col] =
-            days_[row]->log_likelihood_second_derivative() + prior - 0.001;
-      } else if (row == col - 1) {
-        res[row * n + col] = 1. / sigma2[row];
-      } else if (row == col + 1) {
-        res[row * n + col] = 1. / sigma2[col];
+  diagonal.assign(n, 0.);
+  off_diagonal.assign(n - 1, 0.);
+  // The day kernels only touch their own term caches, so blocks of days are
+  // assembled in parallel.
+  parallel_for(blocks, blocks, [&](size_t k) {
+    for (size_t i = k * n / blocks; i < (k + 1) * n / blocks; i++) {
+      Scalar prior = 0.;
+      if (i < n - 1) {
+        prior += -1 / sigma2[i];
+        off_diagonal[i] = 1 / sigma2[i];
       }
+      if (i > 0) {
+        prior += -1 / sigma2[i - 1];
+      }
+      diagonal[i] =
+          days_[i]->log_likelihood_second_derivative<Scalar, Model>() + prior -
+          static_cast<Scalar>(0.001);
     }
-  }
+  });
 }
 
-void Player::gradient(const std::vector<double> &r,
-                      const std::vector<double> &sigma2,
-                      std::vector<double> &res) const {
+template <typename Scalar, typename Model>
+void Player::gradient(const std::vector<Scalar> &r,
+                      const std::vector<Scalar> &sigma2,
+                      std::vector<Scalar> &res, int blocks) const {
   size_t n = days_.size();
-  res = std::vector<double>(n, 0.);
-  for (size_t i = 0; i < n; i++) {
-    auto day = days_[i];
-    double prior = 0.;
-    if (i < n - 1) {
-      prior += -(r[i] - r[i + 1]) / sigma2[i];
-    }
-    if (i > 0) {
-      prior += -(r[i] - r[i - 1]) / sigma2[i - 1];
+  res = std::vector<Scalar>(n, 0.);
+  parallel_for(blocks, blocks, [&](size_t k) {
+    for (size_t i = k * n / blocks; i < (k + 1) * n / blocks; i++) {
+      Scalar prior = 0.;
+      if (i < n - 1) {
+        prior += -(r[i] - r[i + 1]) / sigma2[i];
+      }
+      if (i > 0) {
+        prior += -(r[i] - r[i - 1]) / sigma2[i - 1];
+      }
+      res[i] = days_[i]->log_likelihood_derivative<Scalar, Model>() + prior;
     }
-    res[i] = day->log_likelihood_derivative() + prior;
-  }
+  });
 }
 
-void Player::run_one_newton_iteration() {
+void Player::clear_game_terms_cache() {
   for (auto day : days_) {
     day->clear_game_terms_cache();
   }
+}
+
+void Player::run_one_newton_iteration(double omega) {
+  clear_game_terms_cache();
   if (days_.size() == 1) {
-    days_[0]->update_by_1d_newtons_method();
+    days_[0]->update_by_1d_newtons_method(omega);
   } else if (days_.size() > 1) {
-    update_by_ndim_newton();
+    dispatch_kernel(precision_, outcome_model_, [&](auto scalar, auto model) {
+      update_by_ndim_newton<decltype(scalar), decltype(model)>(omega);
+    });
   }
 }
 
-void Player::compute_sigma2(std::vector<double> &res) const {
+void Player::current_gradient(std::vector<double> &res) {
+  // Opponents may have moved since the term caches were filled.
+  clear_game_terms_cache();
   size_t n = days_.size();
-  res = std::vector<double>(n - 1, 0.);
+  res.assign(n, 0.);
+  if (n == 1) {
+    dispatch_kernel(precision_, outcome_model_, [&](auto scalar, auto model) {
+      res[0] = static_cast<double>(
+          days_[0]->log_likelihood_derivative<decltype(scalar),
+                                              decltype(model)>());
+    });
+  } else if (n > 1) {
+    dispatch_kernel(precision_, outcome_model_, [&](auto scalar, auto model) {
+      using Scalar = decltype(scalar);
+      std::vector<Scalar> r(n), sigma2, g;
+      for (size_t i = 0; i < n; i++) {
+        r[i] = static_cast<Scalar>(days_[i]->get_r());
+      }
+      compute_sigma2(sigma2);
+      gradient<Scalar, decltype(model)>(r, sigma2, g, tridiagonal_blocks(n));
+      for (size_t i = 0; i < n; i++) {
+        res[i] = static_cast<double>(g[i]);
+      }
+    });
+  }
+}
+
+template <typename Scalar>
+void Player::compute_sigma2(std::vector<Scalar> &res) const {
+  size_t n = days_.size();
+  res = std::vector<Scalar>(n - 1, 0.);
   for (size_t i = 0; i < n - 1; i++) {
     auto d1 = days_[i];
     auto d2 = days_[i + 1];
-    res[i] = std::abs(d2->get_time_step() - d1->get_time_step()) * w2_;
+    res[i] = static_cast<Scalar>(
+        std::abs(d2->get_time_step() - d1->get_time_step()) * w2_);
   }
 }
 
-void Player::update_by_ndim_newton() {
+template <typename Scalar, typename Model>
+void Player::update_by_ndim_newton(double omega) {
   size_t n = days_.size();
-  std::vector<double> r(n);
+  int blocks = tridiagonal_blocks(n);
+  std::vector<Scalar> r(n);
   for (size_t i = 0; i < n; i++) {
-    r[i] = days_[i]->get_r();
+    r[i] = static_cast<Scalar>(days_[i]->get_r());
   }
-  std::vector<double> sigma2, h, g;
+  std::vector<Scalar> sigma2, diagonal, off_diagonal, g, x;
   compute_sigma2(sigma2);
-  hessian(sigma2, h);
-  gradient(r, sigma2, g);
-  std::vector<double> a(n, 0.), d(n, 0.), b(n, 0.), y(n, 0.), x(n, 0.);
-  d[0] = h[0];
-  b[0] = h[1];
-  for (size_t i = 1; i < n; i++) {
-    a[i] = h[i * n + i - 1] / d[i - 1];
-    d[i] = h[i * n + i] - a[i] * b[i - 1];
-    if (i < n - 1) {
-      b[i] = h[i * n + i + 1];
-    }
-  }
-  y[0] = g[0];
-  for (size_t i = 1; i < n; i++) {
-    y[i] = g[i] - a[i] * y[i - 1];
-  }
-  x[n - 1] = y[n - 1] / d[n - 1];
-  for (int i = static_cast<int>(n) - 2; i >= 0; i--) {
-    x[i] = (y[i] - b[i] * x[i + 1]) / d[i];
-  }
+  hessian<Scalar, Model>(sigma2, diagonal, off_diagonal, blocks);
+  gradient<Scalar, Model>(r, sigma2, g, blocks);
+  tridiagonal_solve(diagonal, off_diagonal, g, x, blocks);
   for (size_t i = 0; i < n; i++) {
-    days_[i]->set_r(r[i] - x[i]);
+    days_[i]->set_r(days_[i]->get_r() - omega * x[i]);
   }
 }
 
-void Player::covariance(std::vector<double> &res) const {
+template <typename Scalar, typename Model>
+void Player::covariance(std::vector<Scalar> &res) const {
   size_t n = days_.size();
-  std::vector<double> sigma2, h;
+  int blocks = tridiagonal_blocks(n);
+  std::vector<Scalar> sigma2, diagonal, off_diagonal;
   compute_sigma2(sigma2);
-  hessian(sigma2, h);
-  std::vector<double> a(n, 0.), d(n, 0.), b(n, 0.);
-  d[0] = h[0];
-  if (n > 1) {
-    b[0] = h[1];
-  }
-  for (size_t i = 1; i < n; i++) {
-    a[i] = h[i * n + i - 1] / d[i - 1];
-    d[i] = h[i * n + i] - a[i] * b[i - 1];
-    if (i < n - 1) {
-      b[i] = h[i * n + i + 1];
-    }
-  }
-  std::vector<double> dp(n, 0.), bp(n, 0.), ap(n, 0.);
-  dp[n - 1] = h[n * n - 1];
-  bp[n - 1] = h[n * n - 2];
-  for (int i = static_cast<int>(n) - 2; i >= 0; i--) {
-    ap[i] = h[i * n + i + 1] / dp[i + 1];
-    dp[i] = h[i * n + i] - ap[i] * bp[i + 1];
-    bp[i] = h[i * n + i - 1];
-  }
-  std::vector<double> v(n, 0.);
-  for (size_t i = 0; i < n - 1; i++) {
-    v[i] = dp[i + 1] / (b[i] * bp[i + 1] - d[i] * dp[i + 1]);
-  }
-  v[n - 1] = -1. / d[n - 1];
-  res = std::vector<double>(n * n, 0.);
-  for (size_t row = 0; row < n; row++) {
-    for (size_t col = 0; col < n; col++) {
-      if (row == col) {
-        res[row * n + col] = v[row];
-      } else if (row == col - 1) {
-        res[row * n + col] = -a[col] * v[col];
-      }
-    }
-  }
+  hessian<Scalar, Model>(sigma2, diagonal, off_diagonal, blocks);
+  tridiagonal_covariance(diagonal, off_diagonal, res, blocks);
 }
 
 void Player::update_uncertainty() {
   size_t n = days_.size();
   if (n > 0) {
-    std::vector<double> c;
-    covariance(c);
-    for (size_t i = 0; i < n; i++) {
-      days_[i]->set_uncertainty(c[i * n + i]);
-    }
+    dispatch_kernel(precision_, outcome_model_, [&](auto scalar, auto model) {
+      std::vector<decltype(scalar)> c;
+      covariance<decltype(scalar), decltype(model)>(c);
+      for (size_t i = 0; i < n; i++) {
+        days_[i]->set_uncertainty(c[i]);
+      }
+    });
   }
 }
 
@@ -231,4 +227,46 @@ void Player::add_game(std::shared_ptr<Game> game) {
   pday->add_game(game);
 }
 
+void Player::build_days(const std::vector<std::shared_ptr<Game>> &games) {
+  // Bulk counterpart of add_game for a player without days: the games come
+  // sorted by time step, so the days are appended in one pass.
+  std::shared_ptr<Player> self = shared_from_this();
+  std::shared_ptr<PlayerDay> pday;
+  for (const auto &game : games) {
+    const int t = game->get_time_step();
+    if (pday == nullptr || pday->get_time_step() != t) {
+      pday = std::make_shared<PlayerDay>(self, t);
+      pday->set_gamma(days_.empty() ? 1. : days_.back()->gamma());
+      pday->set_is_first_day(days_.empty());
+      days_.push_back(pday);
+    }
+    if (game->get_white_player() == self) {
+      game->set_wpd(pday);
+    } else {
+      game->set_bpd(pday);
+    }
+    pday->add_game(game);
+  }
+}
+
+void Player::remove_game(const std::shared_ptr<Game> game) {
+  std::shared_ptr<PlayerDay> pday =
+      game->get_white_player() == shared_from_this() ? game->get_wpd()
+                                                     : game->get_bpd();
+  pday->remove_game(game);
+  if (!pday->get_games().empty()) {
+    return;
+  }
+  auto it = std::find(days_.begin(), days_.end(), pday);
+  if (it == days_.end()) {
+    return;
+  }
+  bool was_first_day = it == days_.begin();
+  days_.erase(it);
+  if (was_first_day && !days_.empty()) {
+    days_[0]->set_is_first_day(true);
+    days_[0]->clear_game_terms_cache();
+  }
+}
+
 } // namespace whr
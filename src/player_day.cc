@@ -1,4 +1,5 @@
 #include "whr.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <memory>
@@ -6,10 +7,8 @@
 namespace whr {
 
 PlayerDay::PlayerDay(const std::shared_ptr<Player> player, int time_step)
-    : player_(player), time_step_(time_step), is_first_day_(false),
-      won_game_terms_cache_initialized_(false),
-      draw_game_terms_cache_initialized_(false),
-      lost_game_terms_cache_initialized_(false), r_(0.), uncertainty_(0.) {}
+    : player_(player), time_step_(time_step), is_first_day_(false), r_(0.),
+      uncertainty_(0.) {}
 
 void PlayerDay::set_gamma(double gamma) { r_ = std::log(gamma); }
 
@@ -20,124 +19,185 @@ void PlayerDay::set_elo(double elo) { r_ = elo * (std::log(10.) / 400.); }
 double PlayerDay::elo() const { return r_ * (400. / std::log(10.)); }
 
 void PlayerDay::clear_game_terms_cache() {
-  won_game_terms_cache_.clear();
-  draw_game_terms_cache_.clear();
-  lost_game_terms_cache_.clear();
-  won_game_terms_cache_initialized_ = false;
-  draw_game_terms_cache_initialized_ = false;
-  lost_game_terms_cache_initialized_ = false;
+  game_terms_cache_.clear();
+  game_terms_cache_float_.clear();
 }
 
-void PlayerDay::compute_won_game_terms() {
-  if (!won_game_terms_cache_initialized_) {
-    won_game_terms_cache_initialized_ = true;
-    won_game_terms_cache_.clear();
-    for (auto g : won_games_) {
-      double other_gamma = g->opponents_adjusted_gamma(player_);
-      won_game_terms_cache_.push_back(GameTerm(1., 0., 1., other_gamma));
-    }
-  }
+template <> GameTermCache<double> &PlayerDay::game_terms_cache<double>() {
+  return game_terms_cache_;
 }
 
-void PlayerDay::compute_draw_game_terms() {
-  if (!draw_game_terms_cache_initialized_) {
-    draw_game_terms_cache_initialized_ = true;
-    draw_game_terms_cache_.clear();
-    for (auto g : draw_games_) {
-      double other_gamma = g->opponents_adjusted_gamma(player_);
-      draw_game_terms_cache_.push_back(
-          GameTerm(0.5, 0.5 * other_gamma, 1., other_gamma));
-    }
-    if (is_first_day_) {
-      for (int i = 0; i < player_->get_virtual_games(); i++) {
-        draw_game_terms_cache_.push_back(GameTerm(0.5, 0.5, 1., 1.));
-      }
-    }
-  }
+template <> GameTermCache<float> &PlayerDay::game_terms_cache<float>() {
+  return game_terms_cache_float_;
 }
 
-void PlayerDay::compute_lost_game_terms() {
-  if (!lost_game_terms_cache_initialized_) {
-    lost_game_terms_cache_initialized_ = true;
-    lost_game_terms_cache_.clear();
-    for (auto g : lost_games_) {
-      double other_gamma = g->opponents_adjusted_gamma(player_);
-      lost_game_terms_cache_.push_back(
-          GameTerm(0., other_gamma, 1., other_gamma));
+template <typename Scalar, typename Model>
+void PlayerDay::compute_game_terms() {
+  GameTermCache<Scalar> &cache = game_terms_cache<Scalar>();
+  if (!cache.initialized) {
+    cache.clear();
+    cache.initialized = true;
+    for (const auto &g : games_) {
+      Scalar other_gamma = static_cast<Scalar>(
+          g->template opponents_adjusted_gamma<Model::handicap>(player_));
+      bool white = g->get_white_player() == player_;
+      Scalar won = static_cast<Scalar>(white ? g->get_white_wins()
+                                             : g->get_black_wins());
+      Scalar lost = static_cast<Scalar>(white ? g->get_black_wins()
+                                              : g->get_white_wins());
+      if (won > 0) {
+        cache.won.push_back(
+            BasicGameTerm<Scalar>(1., 0., 1., other_gamma, won));
+        cache.won_weight += won;
+      }
+      if (Model::draws && g->get_draws() > 0.) {
+        Scalar draws = static_cast<Scalar>(g->get_draws());
+        cache.draw.push_back(BasicGameTerm<Scalar>(
+            0.5, 0.5 * other_gamma, 1., other_gamma, draws));
+        cache.draw_weight += draws;
+      }
+      if (lost > 0) {
+        cache.lost.push_back(
+            BasicGameTerm<Scalar>(0., other_gamma, 1., other_gamma, lost));
+      }
     }
   }
 }
 
-void PlayerDay::compute_game_terms() {
-  compute_won_game_terms();
-  compute_draw_game_terms();
-  compute_lost_game_terms();
-}
-
-double PlayerDay::log_likelihood_second_derivative() {
-  double sum = 0.;
-  double gamma_this = gamma();
-  compute_game_terms();
-  for (const auto &terms : {won_game_terms_cache_, draw_game_terms_cache_,
-                            lost_game_terms_cache_}) {
-    for (const GameTerm &term : terms) {
-      sum += (term.c * term.d) / std::pow((term.c * gamma_this + term.d), 2);
+// The virtual draws of the first day are all against an opponent of gamma 1,
+// so their contribution is added in closed form instead of as game terms.
+
+template <typename Scalar, typename Model>
+Scalar PlayerDay::log_likelihood_second_derivative() {
+  Scalar sum = 0.;
+  Scalar gamma_this = static_cast<Scalar>(gamma());
+  compute_game_terms<Scalar, Model>();
+  const GameTermCache<Scalar> &cache = game_terms_cache<Scalar>();
+  for (const BasicGameTerm<Scalar> &term : cache.won) {
+    Scalar denominator = term.c * gamma_this + term.d;
+    sum += term.w * (term.c * term.d) / (denominator * denominator);
+  }
+  if (Model::draws) {
+    for (const BasicGameTerm<Scalar> &term : cache.draw) {
+      Scalar denominator = term.c * gamma_this + term.d;
+      sum += term.w * (term.c * term.d) / (denominator * denominator);
     }
   }
+  for (const BasicGameTerm<Scalar> &term : cache.lost) {
+    Scalar denominator = term.c * gamma_this + term.d;
+    sum += term.w * (term.c * term.d) / (denominator * denominator);
+  }
+  if (is_first_day_) {
+    Scalar virtual_games = static_cast<Scalar>(player_->get_virtual_games());
+    sum += virtual_games / ((gamma_this + 1) * (gamma_this + 1));
+  }
   return -gamma_this * sum;
 }
 
-double PlayerDay::log_likelihood_derivative() {
-  double tally = 0.;
-  double gamma_this = gamma();
-  compute_game_terms();
-  for (const auto &terms : {won_game_terms_cache_, draw_game_terms_cache_,
-                            lost_game_terms_cache_}) {
-    for (const GameTerm &term : terms) {
-      tally += term.c / (term.c * gamma_this + term.d);
+template <typename Scalar, typename Model>
+Scalar PlayerDay::log_likelihood_derivative() {
+  Scalar tally = 0.;
+  Scalar gamma_this = static_cast<Scalar>(gamma());
+  compute_game_terms<Scalar, Model>();
+  const GameTermCache<Scalar> &cache = game_terms_cache<Scalar>();
+  Scalar score = cache.won_weight;
+  for (const BasicGameTerm<Scalar> &term : cache.won) {
+    tally += term.w * term.c / (term.c * gamma_this + term.d);
+  }
+  if (Model::draws) {
+    score += static_cast<Scalar>(0.5) * cache.draw_weight;
+    for (const BasicGameTerm<Scalar> &term : cache.draw) {
+      tally += term.w * term.c / (term.c * gamma_this + term.d);
     }
   }
-  return won_game_terms_cache_.size() + 0.5 * draw_game_terms_cache_.size() -
-         gamma_this * tally;
+  for (const BasicGameTerm<Scalar> &term : cache.lost) {
+    tally += term.w * term.c / (term.c * gamma_this + term.d);
+  }
+  if (is_first_day_) {
+    Scalar virtual_games = static_cast<Scalar>(player_->get_virtual_games());
+    score += static_cast<Scalar>(0.5) * virtual_games;
+    tally += virtual_games / (gamma_this + 1);
+  }
+  return score - gamma_this * tally;
 }
 
+template double
+PlayerDay::log_likelihood_second_derivative<double, WinLossModel>();
+template double
+PlayerDay::log_likelihood_second_derivative<double, WinDrawLossModel>();
+template double
+PlayerDay::log_likelihood_second_derivative<double, WinLossHandicapModel>();
+template double
+PlayerDay::log_likelihood_second_derivative<double, WinDrawLossHandicapModel>();
+template float
+PlayerDay::log_likelihood_second_derivative<float, WinLossModel>();
+template float
+PlayerDay::log_likelihood_second_derivative<float, WinDrawLossModel>();
+template float
+PlayerDay::log_likelihood_second_derivative<float, WinLossHandicapModel>();
+template float
+PlayerDay::log_likelihood_second_derivative<float, WinDrawLossHandicapModel>();
+template double PlayerDay::log_likelihood_derivative<double, WinLossModel>();
+template double
+PlayerDay::log_likelihood_derivative<double, WinDrawLossModel>();
+template double
+PlayerDay::log_likelihood_derivative<double, WinLossHandicapModel>();
+template double
+PlayerDay::log_likelihood_derivative<double, WinDrawLossHandicapModel>();
+template float PlayerDay::log_likelihood_derivative<float, WinLossModel>();
+template float PlayerDay::log_likelihood_derivative<float, WinDrawLossModel>();
+template float
+PlayerDay::log_likelihood_derivative<float, WinLossHandicapModel>();
+template float
+PlayerDay::log_likelihood_derivative<float, WinDrawLossHandicapModel>();
+
 double PlayerDay::log_likelihood() {
   double tally = 0.;
   double gamma_this = gamma();
-  compute_game_terms();
-  for (const GameTerm &term : won_game_terms_cache_) {
-    tally += std::log(term.a * gamma_this);
-    tally -= std::log(term.c * gamma_this + term.d);
+  compute_game_terms<double, WinDrawLossHandicapModel>();
+  for (const GameTerm &term : game_terms_cache_.won) {
+    tally += term.w * std::log(term.a * gamma_this);
+    tally -= term.w * std::log(term.c * gamma_this + term.d);
   }
-  for (const GameTerm &term : draw_game_terms_cache_) {
-    tally += std::log(term.a * 2. * gamma_this) * 0.5;
-    tally += std::log(term.b * 2.) * 0.5;
-    tally -= std::log(term.c * gamma_this + term.d);
+  for (const GameTerm &term : game_terms_cache_.draw) {
+    tally += term.w * std::log(term.a * 2. * gamma_this) * 0.5;
+    tally += term.w * std::log(term.b * 2.) * 0.5;
+    tally -= term.w * std::log(term.c * gamma_this + term.d);
   }
-  for (const GameTerm &term : lost_game_terms_cache_) {
-    tally += std::log(term.b);
-    tally -= std::log(term.c * gamma_this + term.d);
+  for (const GameTerm &term : game_terms_cache_.lost) {
+    tally += term.w * std::log(term.b);
+    tally -= term.w * std::log(term.c * gamma_this + term.d);
+  }
+  if (is_first_day_) {
+    tally += player_->get_virtual_games() *
+             (std::log(gamma_this) * 0.5 - std::log(gamma_this + 1.));
   }
   return tally;
 }
 
 void PlayerDay::add_game(const std::shared_ptr<Game> game) {
-  if (game->get_winner() == Winner::DRAW) {
-    draw_games_.push_back(game);
-  } else if ((game->get_winner() == Winner::WHITE &&
-              game->get_white_player() == player_) ||
-             (game->get_winner() == Winner::BLACK &&
-              game->get_black_player() == player_)) {
-    won_games_.push_back(game);
-  } else {
-    lost_games_.push_back(game);
+  games_.push_back(game);
+  clear_game_terms_cache();
+}
+
+void PlayerDay::remove_game(const std::shared_ptr<Game> game) {
+  auto it = std::find(games_.begin(), games_.end(), game);
+  if (it != games_.end()) {
+    games_.erase(it);
   }
+  clear_game_terms_cache();
 }
 
-void PlayerDay::update_by_1d_newtons_method() {
-  double dlogp = log_likelihood_derivative();
-  double d2logp = log_likelihood_second_derivative();
-  r_ -= dlogp / d2logp;
+void PlayerDay::update_by_1d_newtons_method(double omega) {
+  double dlogp, d2logp;
+  dispatch_kernel(player_->get_precision(), player_->get_outcome_model(),
+                  [&](auto scalar, auto model) {
+                    using Scalar = decltype(scalar);
+                    using Model = decltype(model);
+                    dlogp = log_likelihood_derivative<Scalar, Model>();
+                    d2logp = log_likelihood_second_derivative<Scalar, Model>();
+                  });
+  r_ -= omega * dlogp / d2logp;
 }
 
 } // namespace whr
@@ -1,36 +1,207 @@
 #include "whr.h"
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
 
 namespace py = pybind11;
 
+// The core library is pure C++; games and ratings are converted from and to
+// the nested Python lists of the whr package here.
+
+// Base calls run without the GIL, so snapshot readers keep running during
+// iterations, and under the Base's mutex, since the GIL no longer keeps
+// other threads out. Python objects are only touched outside of fn.
+template <typename Fn>
+static auto locked_call(whr::Base &base, Fn fn) -> decltype(fn()) {
+  py::gil_scoped_release release;
+  std::lock_guard<std::mutex> lock(base.get_mutex());
+  return fn();
+}
+
+template <typename Res, typename... Args>
+static auto locked(Res (whr::Base::*method)(Args...)) {
+  return [method](whr::Base &base, Args... args) -> Res {
+    return locked_call(base, [&] { return (base.*method)(args...); });
+  };
+}
+
+template <typename Res, typename... Args>
+static auto locked(Res (whr::Base::*method)(Args...) const) {
+  return [method](whr::Base &base, Args... args) -> Res {
+    return locked_call(base, [&] { return (base.*method)(args...); });
+  };
+}
+
+static std::vector<whr::GameRecord> list_to_game_records(const py::list games) {
+  std::vector<whr::GameRecord> records;
+  records.reserve(games.size());
+  for (const auto item : games) {
+    py::sequence game = py::reinterpret_borrow<py::sequence>(item);
+    double handicap = game.size() >= 5 ? game[4].cast<double>() : 0.;
+    records.emplace_back(game[0].cast<std::string>(),
+                         game[1].cast<std::string>(),
+                         game[2].cast<std::string>(), game[3].cast<int>(),
+                         handicap);
+  }
+  return records;
+}
+
+static std::vector<whr::EvaluateGame>
+list_to_evaluate_games(const py::list games) {
+  std::vector<whr::EvaluateGame> game_list;
+  game_list.reserve(games.size());
+  for (const auto item : games) {
+    py::sequence game = py::reinterpret_borrow<py::sequence>(item);
+    double handicap = game.size() >= 5 ? game[4].cast<double>() : 0.;
+    game_list.emplace_back(game[0].cast<std::string>(),
+                           game[1].cast<std::string>(),
+                           game[2].cast<std::string>(), game[3].cast<int>(),
+                           handicap);
+  }
+  return game_list;
+}
+
+static py::list ratings_to_list(const std::vector<whr::RatingPoint> &ratings) {
+  py::list res;
+  for (const whr::RatingPoint &point : ratings) {
+    py::list pd_info;
+    pd_info.append(point.time_step);
+    pd_info.append(point.elo);
+    pd_info.append(point.stddev);
+    res.append(pd_info);
+  }
+  return res;
+}
+
+static py::list get_ordered_ratings(whr::Base &base) {
+  py::list res;
+  for (const auto &player :
+       locked_call(base, [&] { return base.get_ordered_ratings(); })) {
+    res.append(py::make_tuple(player.first, ratings_to_list(player.second)));
+  }
+  return res;
+}
+
+static py::list ratings_for_player(whr::Base &base, std::string name) {
+  return ratings_to_list(
+      locked_call(base, [&] { return base.ratings_for_player(name); }));
+}
+
+static void create_games(whr::Base &base, const py::list games) {
+  std::vector<whr::GameRecord> records = list_to_game_records(games);
+  locked_call(base, [&] { base.create_games(records); });
+}
+
+static py::dict replay(whr::Base &base, const py::list games) {
+  std::vector<whr::GameRecord> records = list_to_game_records(games);
+  auto series = locked_call(base, [&] { return base.replay(records); });
+  py::dict res;
+  for (const auto &player : series) {
+    res[py::str(player.first)] = ratings_to_list(player.second);
+  }
+  return res;
+}
+
+static double evaluate_ave_log_likelihood_games(const whr::Evaluate &evaluate,
+                                                const py::list games,
+                                                bool ignore_null_players) {
+  return evaluate.evaluate_ave_log_likelihood_games(
+      list_to_evaluate_games(games), ignore_null_players);
+}
+
+static py::list snapshot_ratings_for_player(const whr::RatingSnapshots &reader,
+                                            std::string name) {
+  return ratings_to_list(reader.ratings_for_player(name));
+}
+
 PYBIND11_MODULE(whr_core, m) {
   py::class_<whr::Base>(m, "Base")
-      .def(py::init<double, int>(), py::arg("w2") = 300.,
-           py::arg("virtual_games") = 2)
-      .def("print_ordered_ratings", &whr::Base::print_ordered_ratings)
-      .def("get_ordered_ratings", &whr::Base::get_ordered_ratings)
-      .def("log_likelihood", &whr::Base::log_likelihood)
-      .def("ratings_for_player", &whr::Base::ratings_for_player,
-           py::arg("name"))
-      .def("create_games", &whr::Base::create_games, py::arg("games"))
-      .def("create_game", &whr::Base::create_game, py::arg("black"),
+      .def(py::init<double, int, std::string>(), py::arg("w2") = 300.,
+           py::arg("virtual_games") = 2, py::arg("precision") = "float64")
+      .def("print_ordered_ratings",
+           locked(&whr::Base::print_ordered_ratings))
+      .def("get_ordered_ratings", &get_ordered_ratings)
+      .def("export_ratings", locked(&whr::Base::export_ratings),
+           py::arg("path"), py::arg("chunk_rows") = 65536)
+      .def("log_likelihood", locked(&whr::Base::log_likelihood))
+      .def("outcome_model", locked(&whr::Base::outcome_model))
+      .def("ratings_for_player", &ratings_for_player, py::arg("name"))
+      .def("create_games", &create_games, py::arg("games"))
+      .def("replay", &replay, py::arg("games"))
+      .def("create_game", locked(&whr::Base::create_game), py::arg("black"),
            py::arg("white"), py::arg("winner"), py::arg("time_step"),
            py::arg("handicap") = 0.)
-      .def("iterate_until_converge", &whr::Base::iterate_until_coverge,
-           py::arg("verbose") = true)
-      .def("iterate", &whr::Base::iterate, py::arg("count"));
+      .def("create_weighted_game", locked(&whr::Base::create_weighted_game),
+           py::arg("black"), py::arg("white"), py::arg("time_step"),
+           py::arg("black_wins") = 0., py::arg("white_wins") = 0.,
+           py::arg("draws") = 0., py::arg("handicap") = 0.)
+      .def("remove_game", locked(&whr::Base::remove_game), py::arg("black"),
+           py::arg("white"), py::arg("winner"), py::arg("time_step"),
+           py::arg("handicap") = 0., py::arg("resolve") = true)
+      .def("remove_weighted_game", locked(&whr::Base::remove_weighted_game),
+           py::arg("black"), py::arg("white"), py::arg("time_step"),
+           py::arg("black_wins") = 0., py::arg("white_wins") = 0.,
+           py::arg("draws") = 0., py::arg("handicap") = 0.,
+           py::arg("resolve") = true)
+      .def("update_game_result", locked(&whr::Base::update_game_result),
+           py::arg("black"), py::arg("white"), py::arg("old_winner"),
+           py::arg("new_winner"), py::arg("time_step"),
+           py::arg("handicap") = 0., py::arg("resolve") = true)
+      .def("iterate_until_converge",
+           locked(&whr::Base::iterate_until_coverge),
+           py::arg("verbose") = true, py::arg("acceleration") = "none",
+           py::arg("omega") = 1.)
+      .def("iterate_components_until_converge",
+           locked(&whr::Base::iterate_components_until_converge),
+           py::arg("threads") = 0, py::arg("acceleration") = "none",
+           py::arg("omega") = 1.)
+      .def("iterate_multilevel", locked(&whr::Base::iterate_multilevel),
+           py::arg("bucket_sizes") = std::vector<int>{30, 7},
+           py::arg("verbose") = true, py::arg("acceleration") = "none",
+           py::arg("omega") = 1.)
+      .def("iterate_prioritized", locked(&whr::Base::iterate_prioritized),
+           py::arg("max_updates"), py::arg("tolerance") = 1e-6)
+      .def("iterate", locked(&whr::Base::iterate), py::arg("count"),
+           py::arg("acceleration") = "none", py::arg("omega") = 1.)
+      .def("component_for_player", locked(&whr::Base::component_for_player),
+           py::arg("name"))
+      .def("snapshot_reader", locked(&whr::Base::snapshot_reader));
+
+  py::class_<whr::RatingSnapshots, std::shared_ptr<whr::RatingSnapshots>>(
+      m, "RatingSnapshots")
+      .def("get_version", &whr::RatingSnapshots::get_version)
+      .def("get_rating", &whr::RatingSnapshots::get_rating, py::arg("name"),
+           py::arg("time_step"), py::arg("ignore_null_players") = true)
+      .def("ratings_for_player", &snapshot_ratings_for_player,
+           py::arg("name"));
 
   py::class_<whr::Evaluate>(m, "Evaluate")
-      .def(py::init<whr::Base &>(), py::arg("base"))
+      .def(py::init([](whr::Base &base) {
+             return locked_call(
+                 base, [&] { return std::make_unique<whr::Evaluate>(base); });
+           }),
+           py::arg("base"))
       .def("get_rating", &whr::Evaluate::get_rating, py::arg("name"),
            py::arg("time_step"), py::arg("ignore_null_players") = true)
       .def("evaluate_ave_log_likelihood_games",
-           &whr::Evaluate::evaluate_ave_log_likelihood_games, py::arg("games"),
+           &evaluate_ave_log_likelihood_games, py::arg("games"),
            py::arg("ignore_null_players") = true);
 
+  py::class_<whr::Tournament>(m, "Tournament")
+      .def(py::init([](whr::Base &base) {
+             return locked_call(base, [&] {
+               return std::make_unique<whr::Tournament>(base);
+             });
+           }),
+           py::arg("base"))
+      .def("placement_probabilities", &whr::Tournament::placement_probabilities,
+           py::arg("players"), py::arg("time_step"),
+           py::arg("format") = "round_robin", py::arg("simulations") = 10000,
+           py::arg("rounds") = 0, py::arg("seed") = 0, py::arg("threads") = 0,
+           py::call_guard<py::gil_scoped_release>());
+
 #ifdef VERSION_INFO
   m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
 #else
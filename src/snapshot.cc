@@ -0,0 +1,126 @@
+#include "whr.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace whr {
+
+void RatingSnapshot::assign(
+    const std::unordered_map<std::string, std::shared_ptr<Player>> &players,
+    long version) {
+  // Rebuilt in place so the buffers of a republished slot are reused.
+  for (const auto &player : players) {
+    std::vector<RatingPoint> &ratings = ratings_by_players_[player.first];
+    ratings.clear();
+    for (const auto d : player.second->get_days()) {
+      ratings.emplace_back(d->get_time_step(), d->elo(),
+                           std::sqrt(d->get_uncertainty()) * 400. /
+                               std::log(10.));
+    }
+  }
+  version_ = version;
+}
+
+const std::vector<RatingPoint> *
+RatingSnapshot::ratings_for_player(const std::string &name) const {
+  auto it = ratings_by_players_.find(name);
+  if (it == ratings_by_players_.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+double RatingSnapshot::get_rating(const std::string &name, int time_step,
+                                  bool ignore_null_players) const {
+  const std::vector<RatingPoint> *ratings = ratings_for_player(name);
+  if (ratings == nullptr) {
+    return ignore_null_players ? std::numeric_limits<double>::quiet_NaN() : 0.;
+  }
+  if (ratings->empty()) {
+    return 0.;
+  }
+  return interpolate(*ratings, time_step).elo;
+}
+
+RatingPoint RatingSnapshot::interpolate(const std::vector<RatingPoint> &ratings,
+                                        int time_step) {
+  // Player days are kept sorted by time step.
+  auto it = std::lower_bound(
+      ratings.begin(), ratings.end(), time_step,
+      [](const RatingPoint &r, int t) { return r.time_step < t; });
+  if (it == ratings.end()) {
+    return RatingPoint(time_step, ratings.back().elo, ratings.back().stddev);
+  }
+  if (it == ratings.begin() || it->time_step == time_step) {
+    return RatingPoint(time_step, it->elo, it->stddev);
+  }
+  const RatingPoint &prev = *(it - 1);
+  return RatingPoint(time_step,
+                     ((it->time_step - time_step) * prev.elo +
+                      (time_step - prev.time_step) * it->elo) /
+                         (it->time_step - prev.time_step),
+                     ((it->time_step - time_step) * prev.stddev +
+                      (time_step - prev.time_step) * it->stddev) /
+                         (it->time_step - prev.time_step));
+}
+
+RatingSnapshots::RatingSnapshots() : current_(0) {
+  readers_[0].store(0);
+  readers_[1].store(0);
+}
+
+int RatingSnapshots::pin() const {
+  while (true) {
+    int slot = current_.load();
+    readers_[slot].fetch_add(1);
+    // The writer may have started rebuilding this slot between the two
+    // loads; it only does so after flipping current_ away from it.
+    if (current_.load() == slot) {
+      return slot;
+    }
+    readers_[slot].fetch_sub(1);
+  }
+}
+
+void RatingSnapshots::publish(
+    const std::unordered_map<std::string, std::shared_ptr<Player>> &players) {
+  int current = current_.load();
+  int next = 1 - current;
+  while (readers_[next].load() != 0) {
+    std::this_thread::yield();
+  }
+  slots_[next].assign(players, slots_[current].get_version() + 1);
+  current_.store(next);
+}
+
+long RatingSnapshots::get_version() const {
+  int slot = pin();
+  long version = slots_[slot].get_version();
+  unpin(slot);
+  return version;
+}
+
+double RatingSnapshots::get_rating(const std::string &name, int time_step,
+                                   bool ignore_null_players) const {
+  int slot = pin();
+  double rating =
+      slots_[slot].get_rating(name, time_step, ignore_null_players);
+  unpin(slot);
+  return rating;
+}
+
+std::vector<RatingPoint>
+RatingSnapshots::ratings_for_player(const std::string &name) const {
+  std::vector<RatingPoint> res;
+  int slot = pin();
+  const std::vector<RatingPoint> *ratings =
+      slots_[slot].ratings_for_player(name);
+  if (ratings != nullptr) {
+    res = *ratings;
+  }
+  unpin(slot);
+  return res;
+}
+
+} // namespace whr
@@ -0,0 +1,281 @@
+#include "whr.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+namespace whr {
+
+Tournament::Tournament(Base &base) { snapshot_.assign(base.get_players(), 0); }
+
+TournamentFormat Tournament::parse_format(std::string format) {
+  if (format == "round_robin") {
+    return TournamentFormat::ROUND_ROBIN;
+  } else if (format == "swiss") {
+    return TournamentFormat::SWISS;
+  } else if (format == "single_elimination") {
+    return TournamentFormat::SINGLE_ELIMINATION;
+  }
+  throw std::invalid_argument("Unknown tournament format: " + format);
+}
+
+// SplitMix64 finalizer, used to derive an independent generator seed for
+// every simulation from the user seed and the simulation index.
+static uint64_t mix_seed(uint64_t seed, uint64_t simulation) {
+  uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (simulation + 1);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// One simulated field. Games are decided as wins or losses by the Elo
+// (Bradley-Terry) model on ratings sampled from the players' posteriors.
+class SimulatedField {
+  std::mt19937_64 &rng_;
+  std::vector<double> elos_;
+  std::uniform_real_distribution<double> uniform_;
+
+public:
+  SimulatedField(std::mt19937_64 &rng, const std::vector<RatingPoint> &field)
+      : rng_(rng), uniform_(0., 1.) {
+    for (const RatingPoint &point : field) {
+      std::normal_distribution<double> posterior(point.elo, point.stddev);
+      elos_.push_back(point.stddev > 0. ? posterior(rng_) : point.elo);
+    }
+  }
+  size_t size() const { return elos_.size(); }
+  // Returns the winner of a game between players a and b.
+  size_t play(size_t a, size_t b) {
+    double p =
+        1. / (1. + std::exp((elos_[b] - elos_[a]) * std::log(10.) / 400.));
+    return uniform_(rng_) < p ? a : b;
+  }
+  // Orders the players by decreasing key, then by decreasing tie key if
+  // given; remaining ties are broken at random.
+  std::vector<size_t> rank(const std::vector<double> &keys,
+                           const std::vector<double> &tie_keys = {}) {
+    std::vector<double> tie_breaks(size());
+    for (double &tie_break : tie_breaks) {
+      tie_break = uniform_(rng_);
+    }
+    std::vector<size_t> order(size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      if (keys[a] != keys[b]) {
+        return keys[a] > keys[b];
+      }
+      if (!tie_keys.empty() && tie_keys[a] != tie_keys[b]) {
+        return tie_keys[a] > tie_keys[b];
+      }
+      return tie_breaks[a] < tie_breaks[b];
+    });
+    return order;
+  }
+};
+
+static std::vector<size_t> round_robin(SimulatedField &field, int rounds) {
+  size_t n = field.size();
+  std::vector<double> scores(n, 0.);
+  for (int round = 0; round < rounds; round++) {
+    for (size_t a = 0; a < n; a++) {
+      for (size_t b = a + 1; b < n; b++) {
+        scores[field.play(a, b)] += 1.;
+      }
+    }
+  }
+  return field.rank(scores);
+}
+
+static std::vector<size_t> swiss(SimulatedField &field, int rounds) {
+  size_t n = field.size();
+  std::vector<double> scores(n, 0.);
+  std::vector<std::vector<bool>> played(n, std::vector<bool>(n, false));
+  std::vector<bool> had_bye(n, false);
+  std::vector<std::vector<size_t>> opponents(n);
+  for (int round = 0; round < rounds; round++) {
+    // Standings by score, then by seed.
+    std::vector<size_t> standings(n);
+    for (size_t i = 0; i < n; i++) {
+      standings[i] = i;
+    }
+    std::stable_sort(standings.begin(), standings.end(),
+                     [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+    std::vector<bool> paired(n, false);
+    if (n % 2 == 1) {
+      // The lowest player without a bye yet sits out and scores a point.
+      size_t bye = standings[n - 1];
+      for (size_t k = n; k-- > 0;) {
+        if (!had_bye[standings[k]]) {
+          bye = standings[k];
+          break;
+        }
+      }
+      had_bye[bye] = true;
+      paired[bye] = true;
+      scores[bye] += 1.;
+    }
+    // Each player meets the next one in the standings not yet played, or
+    // the next one available if all of them have been played.
+    for (size_t k = 0; k < n; k++) {
+      size_t a = standings[k];
+      if (paired[a]) {
+        continue;
+      }
+      size_t fallback = n, opponent = n;
+      for (size_t l = k + 1; l < n; l++) {
+        size_t b = standings[l];
+        if (paired[b]) {
+          continue;
+        }
+        if (fallback == n) {
+          fallback = b;
+        }
+        if (!played[a][b]) {
+          opponent = b;
+          break;
+        }
+      }
+      if (opponent == n) {
+        opponent = fallback;
+      }
+      if (opponent == n) {
+        break;
+      }
+      paired[a] = paired[opponent] = true;
+      played[a][opponent] = played[opponent][a] = true;
+      opponents[a].push_back(opponent);
+      opponents[opponent].push_back(a);
+      scores[field.play(a, opponent)] += 1.;
+    }
+  }
+  // Final standings by score, then by the opponents' total score (Buchholz).
+  std::vector<double> buchholz(n, 0.);
+  for (size_t i = 0; i < n; i++) {
+    for (size_t opponent : opponents[i]) {
+      buchholz[i] += scores[opponent];
+    }
+  }
+  return field.rank(scores, buchholz);
+}
+
+static std::vector<size_t> single_elimination(SimulatedField &field) {
+  size_t n = field.size();
+  // Standard bracket: seeds 1 and 2 can only meet in the final, 1 to 4 in
+  // the semifinals, and so on. Slots beyond the field are byes.
+  std::vector<size_t> bracket = {0};
+  while (bracket.size() < n) {
+    size_t size = 2 * bracket.size();
+    std::vector<size_t> next;
+    for (size_t seed : bracket) {
+      next.push_back(seed);
+      next.push_back(size - 1 - seed);
+    }
+    bracket = next;
+  }
+  std::vector<double> survived(n, 0.);
+  int round = 0;
+  while (bracket.size() > 1) {
+    round++;
+    std::vector<size_t> next;
+    for (size_t k = 0; k < bracket.size(); k += 2) {
+      size_t a = bracket[k], b = bracket[k + 1];
+      size_t winner = b >= n ? a : (a >= n ? b : field.play(a, b));
+      if (winner < n) {
+        survived[winner] = round;
+      }
+      next.push_back(winner);
+    }
+    bracket = next;
+  }
+  if (bracket[0] < n) {
+    survived[bracket[0]] = round + 1;
+  }
+  return field.rank(survived);
+}
+
+std::vector<std::vector<double>> Tournament::placement_probabilities(
+    const std::vector<std::string> &players, int time_step, std::string format,
+    int simulations, int rounds, uint64_t seed, int threads) const {
+  TournamentFormat tournament_format = parse_format(format);
+  if (players.empty()) {
+    throw std::invalid_argument("Tournament needs at least one player");
+  }
+  if (simulations <= 0) {
+    throw std::invalid_argument("Number of simulations must be positive");
+  }
+  if (rounds < 0) {
+    throw std::invalid_argument("Number of rounds cannot be negative");
+  }
+  std::vector<RatingPoint> field;
+  std::unordered_set<std::string> names;
+  for (const std::string &name : players) {
+    const std::vector<RatingPoint> *ratings =
+        snapshot_.ratings_for_player(name);
+    if (ratings == nullptr || ratings->empty()) {
+      throw std::invalid_argument("Unknown player: " + name);
+    }
+    if (!names.insert(name).second) {
+      throw std::invalid_argument("Duplicate player: " + name);
+    }
+    field.push_back(RatingSnapshot::interpolate(*ratings, time_step));
+  }
+  size_t n = players.size();
+  if (rounds == 0) {
+    rounds = 1;
+    if (tournament_format == TournamentFormat::SWISS) {
+      // Enough rounds to single out a winner, as in most Swiss events.
+      while ((size_t{1} << rounds) < n) {
+        rounds++;
+      }
+    }
+  }
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  // Every simulation draws from its own generator, and each chunk counts
+  // placements on its own, so the result does not depend on the threads.
+  size_t chunks = std::min(static_cast<size_t>(std::max(threads, 1)),
+                           static_cast<size_t>(simulations));
+  std::vector<std::vector<uint64_t>> counts(chunks,
+                                            std::vector<uint64_t>(n * n, 0));
+  parallel_for(chunks, threads, [&](size_t chunk) {
+    size_t begin = chunk * simulations / chunks;
+    size_t end = (chunk + 1) * simulations / chunks;
+    for (size_t simulation = begin; simulation < end; simulation++) {
+      std::mt19937_64 rng(mix_seed(seed, simulation));
+      SimulatedField simulated(rng, field);
+      std::vector<size_t> order;
+      switch (tournament_format) {
+      case TournamentFormat::SWISS:
+        order = swiss(simulated, rounds);
+        break;
+      case TournamentFormat::SINGLE_ELIMINATION:
+        order = single_elimination(simulated);
+        break;
+      default:
+        order = round_robin(simulated, rounds);
+        break;
+      }
+      for (size_t place = 0; place < n; place++) {
+        counts[chunk][order[place] * n + place]++;
+      }
+    }
+  });
+  std::vector<std::vector<double>> res(n, std::vector<double>(n, 0.));
+  for (size_t i = 0; i < n; i++) {
+    for (size_t place = 0; place < n; place++) {
+      uint64_t count = 0;
+      for (size_t chunk = 0; chunk < chunks; chunk++) {
+        count += counts[chunk][i * n + place];
+      }
+      res[i][place] = static_cast<double>(count) / simulations;
+    }
+  }
+  return res;
+}
+
+} // namespace whr
@@ -0,0 +1,189 @@
+#include "whr.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace whr {
+
+// Histories shorter than this are solved with the plain Thomas algorithm.
+const size_t LONG_HISTORY_DAYS = 4096;
+const size_t MIN_BLOCK_DAYS = 1024;
+
+int tridiagonal_blocks(size_t n) {
+  // Inside a parallel loop over players the cores are already busy.
+  if (n < LONG_HISTORY_DAYS || in_parallel_for()) {
+    return 1;
+  }
+  size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  return static_cast<int>(std::min(threads, n / MIN_BLOCK_DAYS));
+}
+
+template <typename Scalar> class AffineMap {
+public:
+  Scalar a, b;
+  AffineMap(Scalar a = 1, Scalar b = 0) : a(a), b(b) {}
+  AffineMap then(const AffineMap &next) const {
+    return AffineMap(next.a * a, next.a * b + next.b);
+  }
+  Scalar apply(Scalar x) const { return a * x + b; }
+};
+
+// x -> (m00 x + m01) / (m10 x + m11), kept as a 2x2 matrix that is rescaled
+// after every product so long blocks neither overflow nor underflow.
+template <typename Scalar> class MobiusMap {
+public:
+  Scalar m00, m01, m10, m11;
+  MobiusMap(Scalar m00 = 1, Scalar m01 = 0, Scalar m10 = 0, Scalar m11 = 1)
+      : m00(m00), m01(m01), m10(m10), m11(m11) {}
+  MobiusMap then(const MobiusMap &next) const {
+    MobiusMap res(next.m00 * m00 + next.m01 * m10,
+                  next.m00 * m01 + next.m01 * m11,
+                  next.m10 * m00 + next.m11 * m10,
+                  next.m10 * m01 + next.m11 * m11);
+    Scalar scale = std::max(std::max(std::abs(res.m00), std::abs(res.m01)),
+                            std::max(std::abs(res.m10), std::abs(res.m11)));
+    if (scale > 0) {
+      res.m00 /= scale;
+      res.m01 /= scale;
+      res.m10 /= scale;
+      res.m11 /= scale;
+    }
+    return res;
+  }
+  Scalar apply(Scalar x) const { return (m00 * x + m01) / (m10 * x + m11); }
+};
+
+// Runs out[k] = step(k, out[previous k]) over all k but the first one, in
+// forward or reverse order. With several blocks, each block first composes
+// its steps as maps, the block boundaries are propagated serially, and then
+// every block replays its own steps from its boundary in parallel.
+template <typename Scalar, typename Map, typename MapAt, typename Step>
+static void partitioned_scan(size_t n, bool reverse, int blocks,
+                             std::vector<Scalar> &out, MapAt map_at,
+                             Step step) {
+  auto index = [&](size_t p) { return reverse ? n - 1 - p : p; };
+  size_t steps = n - 1;
+  auto begin = [&](size_t k) { return 1 + k * steps / blocks; };
+  std::vector<Scalar> entry(blocks + 1);
+  entry[0] = out[index(0)];
+  if (blocks > 1) {
+    std::vector<Map> maps(blocks);
+    parallel_for(blocks, blocks, [&](size_t k) {
+      Map map;
+      for (size_t p = begin(k); p < begin(k + 1); p++) {
+        map = map.then(map_at(index(p)));
+      }
+      maps[k] = map;
+    });
+    for (int k = 0; k < blocks; k++) {
+      entry[k + 1] = maps[k].apply(entry[k]);
+    }
+  }
+  parallel_for(blocks, blocks, [&](size_t k) {
+    Scalar previous = entry[k];
+    for (size_t p = begin(k); p < begin(k + 1); p++) {
+      out[index(p)] = step(index(p), previous);
+      previous = out[index(p)];
+    }
+  });
+}
+
+// Forward elimination pivots d[i] = diagonal[i] - off[i - 1]^2 / d[i - 1].
+template <typename Scalar>
+static void forward_pivots(const std::vector<Scalar> &diagonal,
+                           const std::vector<Scalar> &off_diagonal,
+                           std::vector<Scalar> &d, int blocks) {
+  size_t n = diagonal.size();
+  d.assign(n, 0);
+  d[0] = diagonal[0];
+  partitioned_scan<Scalar, MobiusMap<Scalar>>(
+      n, false, blocks, d,
+      [&](size_t i) {
+        return MobiusMap<Scalar>(diagonal[i],
+                                 -off_diagonal[i - 1] * off_diagonal[i - 1],
+                                 1, 0);
+      },
+      [&](size_t i, Scalar previous) {
+        Scalar a = off_diagonal[i - 1] / previous;
+        return diagonal[i] - a * off_diagonal[i - 1];
+      });
+}
+
+template <typename Scalar>
+void tridiagonal_solve(const std::vector<Scalar> &diagonal,
+                       const std::vector<Scalar> &off_diagonal,
+                       const std::vector<Scalar> &rhs, std::vector<Scalar> &x,
+                       int blocks) {
+  size_t n = diagonal.size();
+  blocks = std::max(1, std::min(blocks, static_cast<int>(n / 2)));
+  std::vector<Scalar> d, y(n, 0);
+  forward_pivots(diagonal, off_diagonal, d, blocks);
+  y[0] = rhs[0];
+  partitioned_scan<Scalar, AffineMap<Scalar>>(
+      n, false, blocks, y,
+      [&](size_t i) {
+        return AffineMap<Scalar>(-off_diagonal[i - 1] / d[i - 1], rhs[i]);
+      },
+      [&](size_t i, Scalar previous) {
+        Scalar a = off_diagonal[i - 1] / d[i - 1];
+        return rhs[i] - a * previous;
+      });
+  x.assign(n, 0);
+  x[n - 1] = y[n - 1] / d[n - 1];
+  partitioned_scan<Scalar, AffineMap<Scalar>>(
+      n, true, blocks, x,
+      [&](size_t i) {
+        return AffineMap<Scalar>(-off_diagonal[i] / d[i], y[i] / d[i]);
+      },
+      [&](size_t i, Scalar next) {
+        return (y[i] - off_diagonal[i] * next) / d[i];
+      });
+}
+
+template <typename Scalar>
+void tridiagonal_covariance(const std::vector<Scalar> &diagonal,
+                            const std::vector<Scalar> &off_diagonal,
+                            std::vector<Scalar> &res, int blocks) {
+  size_t n = diagonal.size();
+  blocks = std::max(1, std::min(blocks, static_cast<int>(n / 2)));
+  std::vector<Scalar> d, dp(n, 0);
+  forward_pivots(diagonal, off_diagonal, d, blocks);
+  // Backward elimination pivots, the mirror image of the forward ones.
+  dp[n - 1] = diagonal[n - 1];
+  partitioned_scan<Scalar, MobiusMap<Scalar>>(
+      n, true, blocks, dp,
+      [&](size_t i) {
+        return MobiusMap<Scalar>(diagonal[i],
+                                 -off_diagonal[i] * off_diagonal[i], 1, 0);
+      },
+      [&](size_t i, Scalar next) {
+        Scalar a = off_diagonal[i] / next;
+        return diagonal[i] - a * off_diagonal[i];
+      });
+  res.assign(n, 0);
+  parallel_for(blocks, blocks, [&](size_t k) {
+    size_t end = std::min((k + 1) * n / blocks, n - 1);
+    for (size_t i = k * n / blocks; i < end; i++) {
+      res[i] = dp[i + 1] /
+               (off_diagonal[i] * off_diagonal[i] - d[i] * dp[i + 1]);
+    }
+  });
+  res[n - 1] = -1 / d[n - 1];
+}
+
+template void tridiagonal_solve<double>(const std::vector<double> &,
+                                        const std::vector<double> &,
+                                        const std::vector<double> &,
+                                        std::vector<double> &, int);
+template void tridiagonal_solve<float>(const std::vector<float> &,
+                                       const std::vector<float> &,
+                                       const std::vector<float> &,
+                                       std::vector<float> &, int);
+template void tridiagonal_covariance<double>(const std::vector<double> &,
+                                             const std::vector<double> &,
+                                             std::vector<double> &, int);
+template void tridiagonal_covariance<float>(const std::vector<float> &,
+                                            const std::vector<float> &,
+                                            std::vector<float> &, int);
+
+} // namespace whr
@@ -1,24 +1,151 @@
+#pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
 #include <memory>
-#include <pybind11/pybind11.h>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-namespace py = pybind11;
-
 namespace whr {
 const double PI = 3.14159265358979323846;
 
 enum class Winner { WHITE, BLACK, DRAW };
 
+enum class Acceleration { NONE, SOR, ANDERSON };
+
+enum class Precision { FLOAT64, FLOAT32 };
+
+enum class TournamentFormat { ROUND_ROBIN, SWISS, SINGLE_ELIMINATION };
+
+enum class OutcomeModel {
+  WIN_LOSS,
+  WIN_DRAW_LOSS,
+  WIN_LOSS_HANDICAP,
+  WIN_DRAW_LOSS_HANDICAP
+};
+
+template <bool Draws, bool Handicap> class OutcomePolicy {
+public:
+  static constexpr bool draws = Draws;
+  static constexpr bool handicap = Handicap;
+};
+
+using WinLossModel = OutcomePolicy<false, false>;
+using WinDrawLossModel = OutcomePolicy<true, false>;
+using WinLossHandicapModel = OutcomePolicy<false, true>;
+using WinDrawLossHandicapModel = OutcomePolicy<true, true>;
+
+// Calls fn(Scalar(), Model()) with the kernel types matching the run-time
+// precision and outcome model, so each combination gets its own code path.
+template <typename Scalar, typename Function>
+void dispatch_outcome_model(OutcomeModel model, Function &&fn) {
+  switch (model) {
+  case OutcomeModel::WIN_LOSS:
+    fn(Scalar(), WinLossModel());
+    break;
+  case OutcomeModel::WIN_DRAW_LOSS:
+    fn(Scalar(), WinDrawLossModel());
+    break;
+  case OutcomeModel::WIN_LOSS_HANDICAP:
+    fn(Scalar(), WinLossHandicapModel());
+    break;
+  default:
+    fn(Scalar(), WinDrawLossHandicapModel());
+    break;
+  }
+}
+
+template <typename Function>
+void dispatch_kernel(Precision precision, OutcomeModel model, Function &&fn) {
+  if (precision == Precision::FLOAT32) {
+    dispatch_outcome_model<float>(model, fn);
+  } else {
+    dispatch_outcome_model<double>(model, fn);
+  }
+}
+
 class Game;
+class Player;
 class PlayerDay;
 
-class GameTerm {
+// Calls made from inside another parallel_for run serially, so only the
+// outermost loop fans out.
+void parallel_for(size_t count, int threads,
+                  const std::function<void(size_t)> &fn);
+bool in_parallel_for();
+
+// The Newton systems along a player's history are symmetric tridiagonal.
+// Long histories are split into blocks whose recurrences run in parallel.
+int tridiagonal_blocks(size_t n);
+template <typename Scalar>
+void tridiagonal_solve(const std::vector<Scalar> &diagonal,
+                       const std::vector<Scalar> &off_diagonal,
+                       const std::vector<Scalar> &rhs, std::vector<Scalar> &x,
+                       int blocks = 1);
+template <typename Scalar>
+void tridiagonal_covariance(const std::vector<Scalar> &diagonal,
+                            const std::vector<Scalar> &off_diagonal,
+                            std::vector<Scalar> &res, int blocks = 1);
+
+template <typename Scalar> class BasicGameTerm {
+public:
+  Scalar a, b, c, d, w;
+  BasicGameTerm(Scalar a, Scalar b, Scalar c, Scalar d, Scalar w = 1.)
+      : a(a), b(b), c(c), d(d), w(w) {}
+};
+
+using GameTerm = BasicGameTerm<double>;
+
+template <typename Scalar> class GameTermCache {
+public:
+  std::vector<BasicGameTerm<Scalar>> won;
+  std::vector<BasicGameTerm<Scalar>> draw;
+  std::vector<BasicGameTerm<Scalar>> lost;
+  Scalar won_weight;
+  Scalar draw_weight;
+  bool initialized;
+  GameTermCache() : won_weight(0.), draw_weight(0.), initialized(false) {}
+  void clear() {
+    won.clear();
+    draw.clear();
+    lost.clear();
+    won_weight = 0.;
+    draw_weight = 0.;
+    initialized = false;
+  }
+};
+
+class GameKey {
+public:
+  const Player *white_player;
+  const Player *black_player;
+  int time_step;
+  double handicap;
+  GameKey(const Player *white_player, const Player *black_player,
+          int time_step, double handicap)
+      : white_player(white_player), black_player(black_player),
+        time_step(time_step), handicap(handicap) {}
+  bool operator==(const GameKey &other) const {
+    return white_player == other.white_player &&
+           black_player == other.black_player &&
+           time_step == other.time_step && handicap == other.handicap;
+  }
+};
+
+class GameKeyHash {
 public:
-  double a, b, c, d;
-  GameTerm(double a, double b, double c, double d) : a(a), b(b), c(c), d(d) {}
+  size_t operator()(const GameKey &key) const {
+    size_t h = std::hash<const Player *>()(key.white_player);
+    h = h * 31 + std::hash<const Player *>()(key.black_player);
+    h = h * 31 + std::hash<int>()(key.time_step);
+    h = h * 31 + std::hash<double>()(key.handicap == 0. ? 0. : key.handicap);
+    return h;
+  }
 };
 
 class EvaluateGame {
@@ -36,31 +163,75 @@ public:
         time_step(time_step), handicap(handicap) {}
 };
 
+class GameRecord {
+public:
+  std::string black_player;
+  std::string white_player;
+  int time_step;
+  double black_wins;
+  double white_wins;
+  double draws;
+  double handicap;
+  GameRecord(std::string black_player, std::string white_player,
+             std::string winner, int time_step, double handicap = 0.)
+      : black_player(black_player), white_player(white_player),
+        time_step(time_step), black_wins(winner == "B" ? 1. : 0.),
+        white_wins(winner == "W" ? 1. : 0.),
+        draws(winner == "B" || winner == "W" ? 0. : 1.), handicap(handicap) {}
+  GameRecord(std::string black_player, std::string white_player,
+             int time_step, double black_wins, double white_wins,
+             double draws, double handicap = 0.)
+      : black_player(black_player), white_player(white_player),
+        time_step(time_step), black_wins(black_wins), white_wins(white_wins),
+        draws(draws), handicap(handicap) {}
+};
+
 class Player : public std::enable_shared_from_this<Player> {
   std::string name_;
   double w2_;
   int virtual_games_;
+  Precision precision_;
+  OutcomeModel outcome_model_;
+  int component_;
   std::vector<std::shared_ptr<PlayerDay>> days_;
   std::string inspect() const;
-  void hessian(const std::vector<double> &sigma2,
-               std::vector<double> &res) const;
-  void gradient(const std::vector<double> &r, const std::vector<double> &sigma2,
-                std::vector<double> &res) const;
-  void compute_sigma2(std::vector<double> &res) const;
-  void update_by_ndim_newton();
-  void covariance(std::vector<double> &res) const;
+  template <typename Scalar, typename Model>
+  void hessian(const std::vector<Scalar> &sigma2, std::vector<Scalar> &diagonal,
+               std::vector<Scalar> &off_diagonal, int blocks) const;
+  template <typename Scalar, typename Model>
+  void gradient(const std::vector<Scalar> &r, const std::vector<Scalar> &sigma2,
+                std::vector<Scalar> &res, int blocks) const;
+  template <typename Scalar>
+  void compute_sigma2(std::vector<Scalar> &res) const;
+  template <typename Scalar, typename Model>
+  void update_by_ndim_newton(double omega);
+  template <typename Scalar, typename Model>
+  void covariance(std::vector<Scalar> &res) const;
 
 public:
-  Player(std::string name, double w2, int virtual_games);
+  Player(std::string name, double w2, int virtual_games,
+         Precision precision = Precision::FLOAT64,
+         OutcomeModel outcome_model = OutcomeModel::WIN_DRAW_LOSS_HANDICAP);
   std::string get_name() const { return name_; }
   const std::vector<std::shared_ptr<PlayerDay>> &get_days() const {
     return days_;
   }
   int get_virtual_games() const { return virtual_games_; }
+  Precision get_precision() const { return precision_; }
+  OutcomeModel get_outcome_model() const { return outcome_model_; }
+  void set_outcome_model(OutcomeModel outcome_model) {
+    outcome_model_ = outcome_model;
+  }
+  int get_component() const { return component_; }
+  void set_component(int component) { component_ = component; }
   double log_likelihood() const;
-  void run_one_newton_iteration();
+  void clear_game_terms_cache();
+  void run_one_newton_iteration(double omega = 1.);
+  void current_gradient(std::vector<double> &res);
   void update_uncertainty();
   void add_game(std::shared_ptr<Game> game);
+  void build_days(const std::vector<std::shared_ptr<Game>> &games);
+  void remove_game(const std::shared_ptr<Game> game);
 };
 
 class PlayerDay {
@@ -69,26 +240,21 @@ class PlayerDay {
   bool is_first_day_;
   double r_;
   double uncertainty_;
-  std::vector<std::shared_ptr<Game>> won_games_;
-  std::vector<std::shared_ptr<Game>> draw_games_;
-  std::vector<std::shared_ptr<Game>> lost_games_;
-  std::vector<GameTerm> won_game_terms_cache_;
-  std::vector<GameTerm> draw_game_terms_cache_;
-  std::vector<GameTerm> lost_game_terms_cache_;
-  bool won_game_terms_cache_initialized_;
-  bool draw_game_terms_cache_initialized_;
-  bool lost_game_terms_cache_initialized_;
-
-  void compute_won_game_terms();
-  void compute_draw_game_terms();
-  void compute_lost_game_terms();
-  void compute_game_terms();
+  std::vector<std::shared_ptr<Game>> games_;
+  GameTermCache<double> game_terms_cache_;
+  GameTermCache<float> game_terms_cache_float_;
+
+  template <typename Scalar> GameTermCache<Scalar> &game_terms_cache();
+  template <typename Scalar, typename Model> void compute_game_terms();
 
 public:
   PlayerDay(const std::shared_ptr<Player> player, int time_step);
   double get_r() const { return r_; }
   void set_r(double r) { r_ = r; }
   int get_time_step() const { return time_step_; }
+  const std::vector<std::shared_ptr<Game>> &get_games() const {
+    return games_;
+  }
   double get_uncertainty() const { return uncertainty_; }
   void set_uncertainty(double undertainty) { uncertainty_ = undertainty; }
   void set_is_first_day(bool is_first_day) { is_first_day_ = is_first_day; }
@@ -96,85 +262,277 @@ public:
   double gamma() const;
   void set_elo(double elo);
   double elo() const;
-  double log_likelihood_second_derivative();
-  double log_likelihood_derivative();
+  template <typename Scalar = double, typename Model = WinDrawLossHandicapModel>
+  Scalar log_likelihood_second_derivative();
+  template <typename Scalar = double, typename Model = WinDrawLossHandicapModel>
+  Scalar log_likelihood_derivative();
   double log_likelihood();
   void clear_game_terms_cache();
   void add_game(const std::shared_ptr<Game> game);
-  void update_by_1d_newtons_method();
+  void remove_game(const std::shared_ptr<Game> game);
+  void update_by_1d_newtons_method(double omega = 1.);
 };
 
 class Game {
   int time_step_;
   std::shared_ptr<Player> white_player_;
   std::shared_ptr<Player> black_player_;
-  Winner winner_;
+  double black_wins_;
+  double white_wins_;
+  double draws_;
   double handicap_;
+  size_t index_;
   std::shared_ptr<PlayerDay> wpd_;
   std::shared_ptr<PlayerDay> bpd_;
 
   std::string inspect();
-  std::shared_ptr<Player> opponent(const std::shared_ptr<Player> player);
   double likelihood();
   double white_win_probability();
   double black_win_probability();
 
 public:
   Game(const std::shared_ptr<Player> black, const std::shared_ptr<Player> white,
-       std::string winner, int time_step, double handicap = 0.);
+       int time_step, double handicap = 0.);
   int get_time_step() const { return time_step_; }
-  Winner get_winner() const { return winner_; }
+  double get_black_wins() const { return black_wins_; }
+  double get_white_wins() const { return white_wins_; }
+  double get_draws() const { return draws_; }
+  double get_handicap() const { return handicap_; }
   std::shared_ptr<Player> get_white_player() const { return white_player_; }
   std::shared_ptr<Player> get_black_player() const { return black_player_; }
+  std::shared_ptr<PlayerDay> get_wpd() const { return wpd_; }
+  std::shared_ptr<PlayerDay> get_bpd() const { return bpd_; }
   void set_wpd(const std::shared_ptr<PlayerDay> wpd) { wpd_ = wpd; }
   void set_bpd(const std::shared_ptr<PlayerDay> bpd) { bpd_ = bpd; }
-  double opponents_adjusted_gamma(const std::shared_ptr<Player> player) const;
+  // Position in the database's game list, for constant-time removal.
+  size_t get_index() const { return index_; }
+  void set_index(size_t index) { index_ = index; }
+  std::shared_ptr<Player> opponent(const std::shared_ptr<Player> player) const;
+  void add_results(double black_wins, double white_wins, double draws);
+  double won_weight(const std::shared_ptr<Player> &player) const;
+  double lost_weight(const std::shared_ptr<Player> &player) const;
+  template <bool Handicap = true>
+  double opponents_adjusted_gamma(const std::shared_ptr<Player> &player) const;
+};
+
+class RatingPoint {
+public:
+  int time_step;
+  double elo;
+  double stddev;
+  RatingPoint(int time_step, double elo, double stddev)
+      : time_step(time_step), elo(elo), stddev(stddev) {}
+};
+
+class RatingSnapshot {
+  long version_;
+  std::unordered_map<std::string, std::vector<RatingPoint>> ratings_by_players_;
+
+public:
+  RatingSnapshot() : version_(0) {}
+  void assign(
+      const std::unordered_map<std::string, std::shared_ptr<Player>> &players,
+      long version);
+  long get_version() const { return version_; }
+  const std::vector<RatingPoint> *
+  ratings_for_player(const std::string &name) const;
+  double get_rating(const std::string &name, int time_step,
+                    bool ignore_null_players = true) const;
+  static RatingPoint interpolate(const std::vector<RatingPoint> &ratings,
+                                 int time_step);
+};
+
+// Two snapshot buffers: a single writer rebuilds the one readers are not
+// pinned to and flips current_ between iterations, so readers never take a
+// lock and never see a half-written snapshot.
+class RatingSnapshots {
+  RatingSnapshot slots_[2];
+  std::atomic<int> current_;
+  mutable std::atomic<int> readers_[2];
+  int pin() const;
+  void unpin(int slot) const { readers_[slot].fetch_sub(1); }
+
+public:
+  RatingSnapshots();
+  void publish(
+      const std::unordered_map<std::string, std::shared_ptr<Player>> &players);
+  long get_version() const;
+  double get_rating(const std::string &name, int time_step,
+                    bool ignore_null_players = true) const;
+  std::vector<RatingPoint> ratings_for_player(const std::string &name) const;
+};
+
+// Streams (player, time_step, elo, stddev) rows to the columnar file format
+// described in the README, holding at most one chunk in memory.
+class ColumnarWriter {
+  std::ofstream out_;
+  uint64_t chunk_rows_;
+  uint64_t rows_;
+  std::vector<uint32_t> players_;
+  std::vector<int32_t> time_steps_;
+  std::vector<double> elos_;
+  std::vector<double> stddevs_;
+  std::vector<uint64_t> chunk_offsets_;
+  void write(const void *data, size_t bytes);
+  void flush_chunk();
+
+public:
+  ColumnarWriter(const std::string &path, uint64_t chunk_rows = 65536);
+  void append(uint32_t player, int32_t time_step, double elo, double stddev);
+  void finish(const std::vector<std::string> &names);
+};
+
+class AndersonMixing {
+  size_t depth_;
+  std::vector<std::vector<double>> delta_g_;
+  std::vector<std::vector<double>> delta_f_;
+  std::vector<double> last_g_;
+  std::vector<double> last_f_;
+
+public:
+  AndersonMixing(size_t depth = 5) : depth_(depth) {}
+  void reset();
+  bool extrapolate(const std::vector<double> &x, const std::vector<double> &g,
+                   std::vector<double> &res);
 };
 
 class Base {
   double w2_;
   int virtual_games_;
+  Precision precision_;
+  OutcomeModel outcome_model_;
   std::vector<std::shared_ptr<Game>> games_;
+  std::unordered_map<GameKey, std::shared_ptr<Game>, GameKeyHash> game_records_;
   std::unordered_map<std::string, std::shared_ptr<Player>> players_;
   std::vector<std::string> players_order_;
+  bool components_dirty_;
+  int component_count_;
+  std::shared_ptr<RatingSnapshots> snapshots_;
+  std::mutex mutex_;
   std::shared_ptr<Player> player_by_name(std::string name);
   std::shared_ptr<Game> setup_game(std::string black, std::string white,
-                                   std::string winner, int time_step,
-                                   double handicap);
+                                   int time_step, double handicap);
   void add_game(const std::shared_ptr<Game> game);
-  void run_one_iteration();
+  void add_results(const std::shared_ptr<Game> game, double black_wins,
+                   double white_wins, double draws);
+  std::shared_ptr<Game> find_game(std::string black, std::string white,
+                                  int time_step, double handicap) const;
+  void remove_results(const std::shared_ptr<Game> game, double black_wins,
+                      double white_wins, double draws);
+  void unlink_game(const std::shared_ptr<Game> game);
+  int resolve_locally(const std::vector<std::shared_ptr<Player>> &players);
+  void update_outcome_model(bool draws, bool handicap);
+  std::vector<std::shared_ptr<Player>> sorted_players() const;
+  void compute_components();
+  static int
+  converge_players(const std::vector<std::shared_ptr<Player>> &players,
+                   bool verbose, Acceleration acceleration, double omega,
+                   const std::function<void()> &on_iteration = nullptr);
+  static void collect_r(const std::vector<std::shared_ptr<Player>> &players,
+                        std::vector<double> &res);
+  static void assign_r(const std::vector<std::shared_ptr<Player>> &players,
+                       const std::vector<double> &r);
+  static double
+  refreshed_log_likelihood(const std::vector<std::shared_ptr<Player>> &players);
+  static void
+  run_one_iteration(const std::vector<std::shared_ptr<Player>> &players,
+                    double omega = 1.);
+  static void
+  run_one_iteration(const std::vector<std::shared_ptr<Player>> &players,
+                    Acceleration acceleration, double omega,
+                    AndersonMixing &mixing);
+  static Acceleration parse_acceleration(std::string acceleration);
+  static Precision parse_precision(std::string precision);
+  static void winner_results(std::string winner, double &black_wins,
+                             double &white_wins, double &draws);
+  void publish_snapshot();
+  std::unique_ptr<Base> coarsened(int bucket_size) const;
+  int converge_coarse(Acceleration acceleration, double omega);
+  void warm_start(const Base &coarse, int bucket_size, int coarse_bucket_size);
 
 public:
-  Base(double w2 = 300., int virtual_games = 2);
+  Base(double w2 = 300., int virtual_games = 2,
+       std::string precision = "float64");
   std::unordered_map<std::string, std::shared_ptr<Player>> &get_players() {
     return players_;
   }
+  Precision get_precision() const { return precision_; }
+  OutcomeModel get_outcome_model() const { return outcome_model_; }
+  std::string outcome_model() const;
   void print_ordered_ratings() const;
-  py::list get_ordered_ratings();
+  void export_ratings(std::string path, uint64_t chunk_rows = 65536) const;
+  std::vector<std::pair<std::string, std::vector<RatingPoint>>>
+  get_ordered_ratings();
   double log_likelihood() const;
-  py::list ratings_for_player(std::string name);
-  void create_games(const py::list games);
+  std::vector<RatingPoint> ratings_for_player(std::string name);
+  void create_games(const std::vector<GameRecord> &games, int threads = 0);
+  std::unordered_map<std::string, std::vector<RatingPoint>>
+  replay(const std::vector<GameRecord> &games);
   void create_game(std::string black, std::string white, std::string winner,
                    int time_step, double handicap = 0.);
-  int iterate_until_coverge(bool verbose = true);
-  void iterate(int count);
+  void create_weighted_game(std::string black, std::string white,
+                            int time_step, double black_wins,
+                            double white_wins, double draws,
+                            double handicap = 0.);
+  void remove_game(std::string black, std::string white, std::string winner,
+                   int time_step, double handicap = 0., bool resolve = true);
+  void remove_weighted_game(std::string black, std::string white,
+                            int time_step, double black_wins,
+                            double white_wins, double draws,
+                            double handicap = 0., bool resolve = true);
+  void update_game_result(std::string black, std::string white,
+                          std::string old_winner, std::string new_winner,
+                          int time_step, double handicap = 0.,
+                          bool resolve = true);
+  int iterate_until_coverge(bool verbose = true,
+                            std::string acceleration = "none",
+                            double omega = 1.);
+  int iterate_components_until_converge(int threads = 0,
+                                        std::string acceleration = "none",
+                                        double omega = 1.);
+  void iterate(int count, std::string acceleration = "none",
+               double omega = 1.);
+  int iterate_multilevel(std::vector<int> bucket_sizes = {30, 7},
+                         bool verbose = true,
+                         std::string acceleration = "none",
+                         double omega = 1.);
+  int iterate_prioritized(int max_updates, double tolerance = 1e-6);
+  int component_for_player(std::string name);
+  std::shared_ptr<RatingSnapshots> snapshot_reader();
+  // A Base is not thread-safe; callers sharing one across threads hold this
+  // mutex around every call. Snapshot readers do not need it.
+  std::mutex &get_mutex() { return mutex_; }
 };
 
 class Evaluate {
-  std::unordered_map<std::string, std::vector<std::pair<int, double>>>
-      ratings_by_players_;
+  Precision precision_;
+  RatingSnapshot snapshot_;
+  template <typename Scalar>
+  static double game_probability(Scalar white_rating, Scalar black_rating,
+                                 Scalar handicap, Winner winner);
   double evaluate_single_game(const EvaluateGame &game,
                               bool ignore_null_players = true) const;
-  void list_to_games(const py::list games,
-                     std::vector<EvaluateGame> &game_list) const;
 
 public:
   Evaluate(Base &base);
   double get_rating(std::string name, int time_step,
                     bool ignore_null_players = true) const;
   double
-  evaluate_ave_log_likelihood_games(const py::list games,
+  evaluate_ave_log_likelihood_games(const std::vector<EvaluateGame> &games,
                                     bool ignore_null_players = true) const;
 };
 
+class Tournament {
+  RatingSnapshot snapshot_;
+  static TournamentFormat parse_format(std::string format);
+
+public:
+  Tournament(Base &base);
+  std::vector<std::vector<double>>
+  placement_probabilities(const std::vector<std::string> &players,
+                          int time_step, std::string format = "round_robin",
+                          int simulations = 10000, int rounds = 0,
+                          uint64_t seed = 0, int threads = 0) const;
+};
+
 } // namespace whr
@@ -0,0 +1,92 @@
+// Exercises the C++ library directly, without the Python bindings.
+#undef NDEBUG
+#include "whr.h"
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+
+static void test_output() {
+  whr::Base base;
+  base.create_game("shusaku", "shusai", "B", 1, 0);
+  base.create_game("shusaku", "shusai", "W", 2, 0);
+  base.create_game("shusaku", "shusai", "W", 3, 0);
+  base.create_game("shusaku", "shusai", "W", 4, 0);
+  base.create_game("shusaku", "shusai", "W", 4, 0);
+  base.iterate(50);
+  std::vector<whr::RatingPoint> shusaku = base.ratings_for_player("shusaku");
+  std::vector<whr::RatingPoint> shusai = base.ratings_for_player("shusai");
+  const double expected[4][2] = {{1, -92}, {2, -94}, {3, -95}, {4, -96}};
+  assert(shusaku.size() == 4 && shusai.size() == 4);
+  for (int i = 0; i < 4; i++) {
+    assert(shusaku[i].time_step == expected[i][0]);
+    assert(std::round(shusaku[i].elo) == expected[i][1]);
+    assert(std::round(shusaku[i].stddev) == 147);
+    assert(std::round(shusai[i].elo) == -expected[i][1]);
+  }
+}
+
+static void test_create_games() {
+  std::vector<whr::GameRecord> games = {
+      whr::GameRecord("shusaku", "shusai", "B", 1),
+      whr::GameRecord("shusaku", "shusai", "W", 2),
+      whr::GameRecord("shusaku", "shusai", "W", 3),
+      whr::GameRecord("shusaku", "shusai", 4, 0., 2., 0.),
+  };
+  whr::Base base;
+  base.create_games(games);
+  base.iterate(50);
+  auto ratings = base.get_ordered_ratings();
+  assert(ratings.size() == 2);
+  assert(ratings[0].first == "shusai" && ratings[1].first == "shusaku");
+  assert(ratings[1].second.size() == 4);
+
+  std::vector<whr::EvaluateGame> test_games = {
+      whr::EvaluateGame("shusaku", "shusai", "B", 1),
+      whr::EvaluateGame("shusaku", "shusai", "W", 2),
+      whr::EvaluateGame("shusaku", "shusai", "W", 3),
+      whr::EvaluateGame("shusaku", "shusai", "W", 4),
+      whr::EvaluateGame("shusaku", "shusai", "W", 4),
+  };
+  whr::Evaluate evaluate(base);
+  double log_likelihood =
+      evaluate.evaluate_ave_log_likelihood_games(test_games);
+  assert(std::round(log_likelihood * 100000) == -50215);
+}
+
+static void test_tournament() {
+  std::vector<std::string> names = {"alice", "bob", "carol", "dave", "eve"};
+  whr::Base base;
+  for (int day = 1; day <= 10; day++) {
+    for (size_t i = 0; i < names.size(); i++) {
+      for (size_t j = i + 1; j < names.size(); j++) {
+        base.create_game(names[i], names[j], day % 3 ? "B" : "W", day, 0);
+      }
+    }
+  }
+  base.iterate(50);
+  whr::Tournament tournament(base);
+  for (std::string format : {"round_robin", "swiss", "single_elimination"}) {
+    auto res =
+        tournament.placement_probabilities(names, 10, format, 2000, 0, 1, 1);
+    assert(res == tournament.placement_probabilities(names, 10, format, 2000,
+                                                     0, 1, 3));
+    for (size_t i = 0; i < names.size(); i++) {
+      double player_total = 0., place_total = 0.;
+      for (size_t j = 0; j < names.size(); j++) {
+        player_total += res[i][j];
+        place_total += res[j][i];
+      }
+      assert(std::abs(player_total - 1.) < 1e-9);
+      assert(std::abs(place_total - 1.) < 1e-9);
+    }
+    assert(res[0][0] > res[1][0] && res[1][0] > res[4][0]);
+  }
+}
+
+int main() {
+  test_output();
+  test_create_games();
+  test_tournament();
+  return 0;
+}
@@ -1,6 +1,22 @@
+import os
+import tempfile
+import threading
 import whr
 
 
+def assert_ratings_close(base1, base2, names, tolerance):
+    # Both databases must have the same player days, with ratings and
+    # uncertainties within the tolerance.
+    for name in names:
+        ratings1 = base1.ratings_for_player(name)
+        ratings2 = base2.ratings_for_player(name)
+        assert len(ratings1) == len(ratings2)
+        for r1, r2 in zip(ratings1, ratings2):
+            assert r1[0] == r2[0]
+            assert abs(r1[1] - r2[1]) < tolerance
+            assert abs(r1[2] - r2[2]) < tolerance
+
+
 class WholeHistoryRatingTest:
     def __init__(self):
         self.whr = whr.Base()
@@ -53,12 +69,354 @@ class WholeHistoryRatingTest:
         assert ratings1_alice == ratings2_alice
         assert ratings1_bob == ratings2_bob
 
+    def test_acceleration(self):
+        games = [
+            ["alice", "bob", "W", 1],
+            ["bob", "carol", "B", 1],
+            ["carol", "alice", "D", 2],
+            ["alice", "bob", "B", 3],
+            ["dave", "carol", "W", 3],
+            ["bob", "dave", "W", 4],
+        ]
+        expected = whr.Base()
+        expected.create_games(games)
+        expected.iterate(200)
+        for acceleration, omega in [("sor", 1.3), ("anderson", 1.0)]:
+            accelerated = whr.Base()
+            accelerated.create_games(games)
+            accelerated.iterate(200, acceleration, omega)
+            assert_ratings_close(
+                expected, accelerated, ["alice", "bob", "carol", "dave"], 1e-6
+            )
+
+    def test_components(self):
+        games = [
+            ["alice", "bob", "W", 1],
+            ["bob", "carol", "B", 2],
+            ["dave", "erin", "W", 1],
+            ["erin", "dave", "D", 3],
+        ]
+        expected = whr.Base()
+        expected.create_games(games)
+        expected.iterate_until_converge(False)
+        components = whr.Base()
+        components.create_games(games)
+        components.iterate_components_until_converge(2)
+        assert components.component_for_player("alice") == 0
+        assert components.component_for_player("carol") == 0
+        assert components.component_for_player("dave") == 1
+        assert components.component_for_player("nobody") == -1
+        assert_ratings_close(
+            expected, components, ["alice", "bob", "carol", "dave", "erin"], 0.01
+        )
+
+    def test_precision(self):
+        games = []
+        for day in range(-40, 200, 3):
+            games.append(["alice", "bob", "B" if day % 9 else "W", day])
+            games.append(["bob", "carol", "W" if day % 4 else "B", day + 1])
+            games.append(["carol", "alice", "D" if day % 5 == 0 else "B", day + 2])
+            games.append(["dave", "alice", "W", day, 30.0 if day % 2 else 0.0])
+        expected = whr.Base(precision="float64")
+        expected.create_games(games)
+        expected.iterate_until_converge(False)
+        single = whr.Base(precision="float32")
+        single.create_games(games)
+        single.iterate_until_converge(False)
+        assert_ratings_close(expected, single, ["alice", "bob", "carol", "dave"], 1e-2)
+        try:
+            whr.Base(precision="float16")
+            assert False
+        except ValueError:
+            pass
+
+    def test_outcome_model(self):
+        base = whr.Base()
+        base.create_game("alice", "bob", "W", 1)
+        base.create_game("bob", "alice", "B", 2)
+        assert base.outcome_model() == "win_loss"
+        base.create_game("alice", "bob", "D", 3)
+        assert base.outcome_model() == "win_draw_loss"
+        base.create_game("alice", "bob", "W", 4, 50)
+        assert base.outcome_model() == "win_draw_loss_handicap"
+
+    def test_weighted_game(self):
+        weighted = whr.Base()
+        weighted.create_weighted_game("shusaku", "shusai", 1, black_wins=1)
+        weighted.create_weighted_game("shusaku", "shusai", 2, white_wins=1)
+        weighted.create_weighted_game("shusaku", "shusai", 3, white_wins=1)
+        weighted.create_weighted_game("shusaku", "shusai", 4, white_wins=2)
+        weighted.iterate(50)
+        assert_ratings_close(self.whr, weighted, ["shusaku", "shusai"], 1e-6)
+
+    def test_snapshot_reader(self):
+        base = whr.Base()
+        base.create_game("shusaku", "shusai", "B", 1, 0)
+        base.create_game("shusaku", "shusai", "W", 2, 0)
+        base.create_game("shusaku", "shusai", "W", 3, 0)
+        base.create_game("shusaku", "shusai", "W", 4, 0)
+        base.create_game("shusaku", "shusai", "W", 4, 0)
+        reader = base.snapshot_reader()
+        assert reader.version() == 1
+        assert reader.get_rating("shusaku", 1) == 0.0
+        assert reader.get_rating("nobody", 1) is None
+
+        versions = []
+        failures = []
+        stop = threading.Event()
+
+        # Exceptions raised in the thread would not fail the test, so bad
+        # reads are collected and checked after join().
+        def read():
+            try:
+                while not stop.is_set():
+                    versions.append(reader.version())
+                    rating = reader.get_rating("shusaku", 3)
+                    if rating is None or not abs(rating) < 1000:
+                        failures.append(rating)
+            except Exception as error:
+                failures.append(error)
+
+        thread = threading.Thread(target=read)
+        thread.start()
+        base.iterate(50)
+        stop.set()
+        thread.join()
+        assert failures == []
+        assert versions == sorted(versions)
+        assert reader.version() == 52
+
+        evaluate = whr.Evaluate(self.whr)
+        for time_step in range(6):
+            assert abs(
+                reader.get_rating("shusai", time_step)
+                - evaluate.get_rating("shusai", time_step)
+            ) < 1e-9
+        assert reader.ratings_for_player("shusai") == self.whr.ratings_for_player(
+            "shusai"
+        )
+
+    def test_concurrent_calls(self):
+        games = [["alice", "bob", "B" if day % 3 else "W", day] for day in range(200)]
+        new_games = [["carol", "alice", "B", day] for day in range(200)]
+        base = whr.Base()
+        base.create_games(games)
+        started = threading.Event()
+
+        def run():
+            started.set()
+            base.iterate(2000)
+
+        thread = threading.Thread(target=run)
+        thread.start()
+        started.wait()
+        for game in new_games:
+            base.create_game(*game)
+        thread.join()
+        base.iterate_until_converge(False)
+        expected = whr.Base()
+        expected.create_games(games + new_games)
+        expected.iterate_until_converge(False)
+        assert_ratings_close(expected, base, ["alice", "bob", "carol"], 0.01)
+
+    def test_remove_game(self):
+        base = whr.Base()
+        base.create_game("shusaku", "shusai", "B", 1, 0)
+        base.create_game("shusaku", "shusai", "W", 2, 0)
+        base.create_game("shusaku", "shusai", "B", 3, 0)
+        base.create_game("shusaku", "shusai", "W", 4, 0)
+        base.create_game("shusaku", "shusai", "W", 4, 0)
+        base.create_game("shusaku", "honinbo", "D", 0, 0)
+        base.iterate(50)
+        base.remove_game("shusaku", "honinbo", "D", 0)
+        base.update_game_result("shusaku", "shusai", "B", "W", 3)
+        assert base.ratings_for_player("honinbo") == []
+        assert_ratings_close(self.whr, base, ["shusaku", "shusai"], 0.05)
+        try:
+            base.remove_game("shusaku", "shusai", "B", 3)
+            assert False
+        except ValueError:
+            pass
+
+        for _ in range(3):
+            base.create_weighted_game("honinbo", "shusai", 5, black_wins=0.1)
+        base.remove_weighted_game("honinbo", "shusai", 5, black_wins=0.3)
+        assert base.ratings_for_player("honinbo") == []
+        base.create_weighted_game("honinbo", "shusai", 5, black_wins=1, draws=1)
+        try:
+            base.remove_weighted_game("honinbo", "shusai", 5, black_wins=2)
+            assert False
+        except ValueError:
+            pass
+
+    def test_create_games(self):
+        games = [
+            ["alice", "bob", "W", 3],
+            ["carol", "alice", "D", 1],
+            ["bob", "carol", "B", 2, 30.0],
+            ["alice", "bob", "W", 3],
+            ["bob", "alice", "B", 1],
+        ]
+        expected = whr.Base()
+        for game in sorted(games, key=lambda game: game[3]):
+            expected.create_game(*game)
+        expected.iterate(50)
+
+        bulk = whr.Base()
+        bulk.create_games(games)
+        bulk.iterate(50)
+
+        incremental = whr.Base()
+        incremental.create_games(games[:2])
+        incremental.create_games(games[2:])
+        incremental.iterate(50)
+
+        for name in ["alice", "bob", "carol"]:
+            assert expected.ratings_for_player(name) == bulk.ratings_for_player(name)
+        assert_ratings_close(expected, incremental, ["alice", "bob", "carol"], 1e-6)
+
+    def test_export_ratings(self):
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "ratings.whrc")
+            self.whr.export_ratings(path, chunk_rows=3)
+            columns = whr.read_rating_columns(path)
+        assert columns["names"] == ["shusai", "shusaku"]
+        for index, name in enumerate(columns["names"]):
+            rows = [
+                [columns["time_step"][i], columns["elo"][i], columns["stddev"][i]]
+                for i in range(len(columns["player"]))
+                if columns["player"][i] == index
+            ]
+            assert rows == self.whr.ratings_for_player(name)
+
+    def test_long_history(self):
+        base = whr.Base()
+        days = 5000
+        for time_step in range(days):
+            base.create_game("bot", "rival", "B" if time_step % 2 else "W", time_step)
+        base.iterate(10)
+        bot = base.ratings_for_player("bot")
+        rival = base.ratings_for_player("rival")
+        assert len(bot) == days
+        for r1, r2 in zip(bot, rival):
+            assert abs(r1[1]) < 50
+            assert abs(r1[1] + r2[1]) < 5
+            assert 0 < r1[2] < 1000
+            assert abs(r1[2] - r2[2]) < 1e-3
+
+    def test_replay(self):
+        games = [
+            ["shusaku", "shusai", "B", 1],
+            ["shusaku", "shusai", "W", 2],
+            ["shusaku", "shusai", "W", 3],
+            ["shusaku", "shusai", "W", 4],
+            ["shusaku", "shusai", "W", 4],
+        ]
+        base = whr.Base()
+        series = base.replay(games)
+        assert [rating[0] for rating in series["shusaku"]] == [1, 2, 3, 4]
+        for time_step in [1, 2, 3, 4]:
+            cutoff = whr.Base()
+            cutoff.create_games([game for game in games if game[3] <= time_step])
+            cutoff.iterate_until_converge(False)
+            expected = cutoff.ratings_for_player("shusaku")[-1]
+            actual = series["shusaku"][time_step - 1]
+            assert abs(expected[1] - actual[1]) < 0.1
+            assert abs(expected[2] - actual[2]) < 0.1
+        try:
+            base.replay(games)
+            assert False
+        except ValueError:
+            pass
+
+    def test_multilevel(self):
+        games = []
+        for day in range(-40, 200, 3):
+            games.append(["alice", "bob", "B" if day % 9 else "W", day])
+            games.append(["bob", "carol", "W" if day % 4 else "B", day + 1])
+            games.append(["carol", "alice", "D" if day % 5 == 0 else "B", day + 2])
+        expected = whr.Base()
+        expected.create_games(games)
+        expected.iterate_until_converge(False)
+        multilevel = whr.Base()
+        multilevel.create_games(games)
+        assert multilevel.iterate_multilevel([7, 30], False) > 0
+        assert_ratings_close(expected, multilevel, ["alice", "bob", "carol"], 0.05)
+
+    def test_prioritized(self):
+        games = [
+            ["alice", "bob", "W", 1],
+            ["bob", "carol", "B", 1],
+            ["carol", "alice", "D", 2],
+            ["alice", "bob", "B", 3],
+            ["dave", "carol", "W", 3],
+            ["bob", "dave", "W", 4],
+        ]
+        new_games = [["dave", "alice", "B", 5], ["carol", "bob", "W", 5]]
+        expected = whr.Base()
+        expected.create_games(games + new_games)
+        expected.iterate_until_converge(False)
+        prioritized = whr.Base()
+        prioritized.create_games(games)
+        prioritized.iterate_until_converge(False)
+        prioritized.create_games(new_games)
+        assert prioritized.iterate_prioritized(3) == 3
+        assert 0 < prioritized.iterate_prioritized(10000) < 10000
+        assert_ratings_close(
+            expected, prioritized, ["alice", "bob", "carol", "dave"], 0.01
+        )
+
+    def test_tournament(self):
+        names = ["alice", "bob", "carol", "dave", "eve"]
+        games = []
+        for day in range(1, 11):
+            for i in range(len(names)):
+                for j in range(i + 1, len(names)):
+                    games.append([names[i], names[j], "B" if day % 3 else "W", day])
+        base = whr.Base()
+        base.create_games(games)
+        base.iterate_until_converge(False)
+        tournament = whr.Tournament(base)
+        for format in ["round_robin", "swiss", "single_elimination"]:
+            res = tournament.placement_probabilities(
+                names, 10, format, simulations=2000, seed=1, threads=1
+            )
+            assert list(res) == names
+            for name in names:
+                assert abs(sum(res[name]) - 1.0) < 1e-9
+            for place in range(len(names)):
+                assert abs(sum(res[name][place] for name in names) - 1.0) < 1e-9
+            assert res["alice"][0] > res["bob"][0] > res["eve"][0]
+            assert res == tournament.placement_probabilities(
+                names, 10, format, simulations=2000, seed=1, threads=3
+            )
+        try:
+            tournament.placement_probabilities(["alice", "alice"], 10)
+            assert False
+        except ValueError:
+            pass
+
 
 def test_whr_class():
     whrt = WholeHistoryRatingTest()
     whrt.test_output()
     whrt.test_evaluate()
     whrt.test_game_order_independence()
+    whrt.test_acceleration()
+    whrt.test_components()
+    whrt.test_precision()
+    whrt.test_outcome_model()
+    whrt.test_weighted_game()
+    whrt.test_snapshot_reader()
+    whrt.test_concurrent_calls()
+    whrt.test_remove_game()
+    whrt.test_create_games()
+    whrt.test_export_ratings()
+    whrt.test_long_history()
+    whrt.test_replay()
+    whrt.test_multilevel()
+    whrt.test_prioritized()
+    whrt.test_tournament()
 
 
 if __name__ == "__main__":
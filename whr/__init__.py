@@ -1,3 +1,6 @@
 from whr_core import __version__
 from .base import Base
 from .evaluate import Evaluate
+from .tournament import Tournament
+from .snapshot import SnapshotReader
+from .columnar import read_rating_columns
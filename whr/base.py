@@ -1,11 +1,18 @@
 import whr_core
+from .snapshot import SnapshotReader
 
 
 __version__ = whr_core.__version__
 
 
 class Base:
-    def __init__(self, config: dict = None, w2: float = 300.0, virtual_games: int = 2):
+    def __init__(
+        self,
+        config: dict = None,
+        w2: float = 300.0,
+        virtual_games: int = 2,
+        precision: str = "float64",
+    ):
         """
         Fundamental database for computing whole-history rating (WHR).
 
@@ -13,8 +20,8 @@ class Base:
         ----------
         config : dict, default = None
             Config for setting the parameters for Base.
-            Example: config = {"w2": w2, "virtual_games": virtual_games}
-            If config is unset, the parameters `w2` and `virtual_games` will be used.
+            Example: config = {"w2": w2, "virtual_games": virtual_games, "precision": precision}
+            If config is unset, the parameters `w2`, `virtual_games` and `precision` will be used.
 
         w2 : float, default = 300.0
             The parameter of w^2 described in the paper of Rémi Coulom,
@@ -25,6 +32,13 @@ class Base:
             Number of virtual draw games assigned to player on the first day.
             This parameter is ineffective when `config["virtual_games"]` is set.
 
+        precision : str, {"float64", "float32"}, default = "float64"
+            Floating point precision of the Newton and covariance computations.
+            "float32" halves the memory of the per-game caches and matrices
+            at the cost of a few thousandths of an Elo point; ratings themselves are
+            always stored in double precision.
+            This parameter is ineffective when `config["precision"]` is set.
+
         Example
         -------
         ```
@@ -62,7 +76,9 @@ class Base:
                 w2 = config["w2"]
             if "virtual_games" in config:
                 virtual_games = config["virtual_games"]
-        self.core = whr_core.Base(w2, virtual_games)
+            if "precision" in config:
+                precision = config["precision"]
+        self.core = whr_core.Base(w2, virtual_games, precision)
 
     def print_ordered_ratings(self):
         """
@@ -88,6 +104,23 @@ class Base:
         """
         return self.core.get_ordered_ratings()
 
+    def export_ratings(self, path: str, chunk_rows: int = 65536):
+        """
+        Write the rating histories of all players to a columnar binary file.
+        The rows are streamed in chunks of `chunk_rows`, so memory use stays bounded,
+        and every column is 8-byte aligned so the file can be memory-mapped.
+        The layout is documented in the README; `whr.read_rating_columns` reads it.
+
+        Parameters
+        ----------
+        path : str
+            Path of the output file, overwritten if it exists.
+
+        chunk_rows : int, default = 65536
+            Number of rows per chunk.
+        """
+        self.core.export_ratings(path, chunk_rows)
+
     def log_likelihood(self) -> float:
         """
         Compute the log likehihood for all games in the database.
@@ -99,6 +132,20 @@ class Base:
         """
         return self.core.log_likelihood()
 
+    def outcome_model(self) -> str:
+        """
+        Get the outcome model picked from the games in the database.
+        Specialized kernels skip the work for draws and handicaps
+        until a game needing them is added.
+
+        Returns
+        -------
+        str
+            One of "win_loss", "win_draw_loss", "win_loss_handicap"
+            and "win_draw_loss_handicap".
+        """
+        return self.core.outcome_model()
+
     def ratings_for_player(self, name: str) -> list:
         """
         Get the rating for a player based on the player name.
@@ -121,6 +168,9 @@ class Base:
     def create_games(self, games: list):
         """
         Create a list of games, inserting the games and related players into the database.
+        The games are sorted by time step once and the player days are built in bulk,
+        which gives the same result as calling `create_game` in time-step order
+        but is much faster for large lists.
 
         Parameters
         ----------
@@ -137,6 +187,35 @@ class Base:
         """
         self.core.create_games(games)
 
+    def replay(self, games: list) -> dict:
+        """
+        Add a list of games day by day and record the as-of ratings,
+        i.e. the ratings each player had at the end of each day they played,
+        computed only from the games up to that day.
+        Every day starts from the previous day's ratings and is re-solved
+        locally around the day's players (see `remove_game`),
+        instead of converging a new database for every day.
+        The database must be empty, as its games would otherwise
+        leak into the as-of ratings.
+
+        Parameters
+        ----------
+        games : list
+            List of games in the format of `create_games`.
+
+        Returns
+        -------
+        dict
+            For each player in the games, the list of
+            [time_step, elo, uncertainty] entries of the days they played.
+
+        Raises
+        ------
+        ValueError
+            If the database already has games.
+        """
+        return self.core.replay(games)
+
     def create_game(
         self, black: str, white: str, winner: str, time_step: int, handicap: float = 0.0
     ):
@@ -162,7 +241,153 @@ class Base:
         """
         self.core.create_game(black, white, winner, time_step, handicap)
 
-    def iterate_until_converge(self, verbose: bool = True):
+    def create_weighted_game(
+        self,
+        black: str,
+        white: str,
+        time_step: int,
+        black_wins: float = 0.0,
+        white_wins: float = 0.0,
+        draws: float = 0.0,
+        handicap: float = 0.0,
+    ):
+        """
+        Create a batch of games between two players on the same time step,
+        given by the number of each result.
+        Repeated games between the same players on the same time step
+        with the same handicap are stored as one weighted record,
+        so this is equivalent to calling `create_game` once per game.
+
+        Parameters
+        ----------
+        black : str
+            Name of the black player.
+
+        white : str
+            Name of the white player.
+
+        time_step : int
+            Time step (day) of the games.
+
+        black_wins : float, default = 0.0
+            Number of games won by black.
+
+        white_wins : float, default = 0.0
+            Number of games won by white.
+
+        draws : float, default = 0.0
+            Number of drawn games.
+
+        handicap : float, default = 0.0
+            The advantage of black (by Elo) of the games.
+        """
+        self.core.create_weighted_game(
+            black, white, time_step, black_wins, white_wins, draws, handicap
+        )
+
+    def remove_game(
+        self,
+        black: str,
+        white: str,
+        winner: str,
+        time_step: int,
+        handicap: float = 0.0,
+        resolve: bool = True,
+    ):
+        """
+        Remove a previously created game from the database.
+        Player days left without games are dropped.
+
+        Parameters
+        ----------
+        black : str
+            Name of the black player.
+
+        white : str
+            Name of the white player.
+
+        winner : str, {"B", "W", "D"}
+            Recorded winner of the game.
+
+        time_step : int
+            Time step (day) of the game.
+
+        handicap : float, default = 0.0
+            Recorded handicap of the game.
+
+        resolve : bool, default = True
+            Re-solve the ratings locally afterwards: Newton updates spread
+            from both players through their opponents until no rating moves
+            by more than 0.01 Elo. Pass False when removing many games
+            and iterate once at the end instead.
+
+        Raises
+        ------
+        ValueError
+            If no such game is in the database.
+        """
+        self.core.remove_game(black, white, winner, time_step, handicap, resolve)
+
+    def remove_weighted_game(
+        self,
+        black: str,
+        white: str,
+        time_step: int,
+        black_wins: float = 0.0,
+        white_wins: float = 0.0,
+        draws: float = 0.0,
+        handicap: float = 0.0,
+        resolve: bool = True,
+    ):
+        """
+        Remove a batch of games between two players on the same time step,
+        the counterpart of `create_weighted_game`.
+        See `remove_game` for the other parameters.
+
+        Raises
+        ------
+        ValueError
+            If the database holds fewer games with these results.
+        """
+        self.core.remove_weighted_game(
+            black, white, time_step, black_wins, white_wins, draws, handicap, resolve
+        )
+
+    def update_game_result(
+        self,
+        black: str,
+        white: str,
+        old_winner: str,
+        new_winner: str,
+        time_step: int,
+        handicap: float = 0.0,
+        resolve: bool = True,
+    ):
+        """
+        Correct the result of a previously created game.
+
+        Parameters
+        ----------
+        old_winner : str, {"B", "W", "D"}
+            Recorded winner of the game.
+
+        new_winner : str, {"B", "W", "D"}
+            Corrected winner of the game.
+
+        See `remove_game` for the other parameters.
+
+        Raises
+        ------
+        ValueError
+            If no such game is in the database.
+        """
+        self.core.update_game_result(
+            black, white, old_winner, new_winner, time_step, handicap, resolve
+        )
+
+    def iterate_until_converge(
+        self, verbose: bool = True, acceleration: str = "none", omega: float = 1.0
+    ):
         """
         Iterate the computation until the ratings converge.
         The ratings are considered to have converged
@@ -172,10 +397,142 @@ class Base:
         ----------
         verbose : bool, default = True
             Printing iteration information after each round.
+
+        acceleration : str, {"none", "sor", "anderson"}, default = "none"
+            Convergence acceleration scheme. See `iterate`.
+
+        omega : float, default = 1.0
+            Relaxation factor of the Newton steps. See `iterate`.
+
+        Returns
+        -------
+        int
+            Number of rounds performed.
         """
-        self.core.iterate_until_converge(verbose)
+        return self.core.iterate_until_converge(verbose, acceleration, omega)
 
-    def iterate(self, count: int):
+    def iterate_components_until_converge(
+        self, threads: int = 0, acceleration: str = "none", omega: float = 1.0
+    ) -> int:
+        """
+        Split the players into connected components of the game graph
+        and iterate each component until it converges, in parallel.
+        Players in different components never share a game, so each
+        component is solved and checked for convergence on its own,
+        and small components stop after a few rounds.
+
+        Parameters
+        ----------
+        threads : int, default = 0
+            Number of worker threads. 0 uses all hardware threads.
+
+        acceleration : str, {"none", "sor", "anderson"}, default = "none"
+            Convergence acceleration scheme. See `iterate`.
+
+        omega : float, default = 1.0
+            Relaxation factor of the Newton steps. See `iterate`.
+
+        Returns
+        -------
+        int
+            Largest number of rounds performed by any component.
+        """
+        return self.core.iterate_components_until_converge(threads, acceleration, omega)
+
+    def iterate_multilevel(
+        self,
+        bucket_sizes: list = [30, 7],
+        verbose: bool = True,
+        acceleration: str = "none",
+        omega: float = 1.0,
+    ) -> int:
+        """
+        Iterate until convergence, starting from a coarse-to-fine warm start.
+        For each bucket size, from the largest to the smallest, the time steps
+        are merged into buckets of that many steps (with `w2` scaled by the
+        bucket size), the much smaller coarse problem is converged, and its
+        ratings are interpolated down as the starting point of the next level.
+        The full problem is then solved by `iterate_until_converge`.
+
+        Parameters
+        ----------
+        bucket_sizes : list of int, default = [30, 7]
+            Number of time steps merged into one bucket at each coarse level,
+            e.g. months and then weeks for daily time steps.
+
+        verbose : bool, default = True
+            Printing iteration information of every level.
+
+        acceleration : str, {"none", "sor", "anderson"}, default = "none"
+            Convergence acceleration scheme. See `iterate`.
+
+        omega : float, default = 1.0
+            Relaxation factor of the Newton steps. See `iterate`.
+
+        Returns
+        -------
+        int
+            Number of rounds performed on the full problem.
+        """
+        return self.core.iterate_multilevel(bucket_sizes, verbose, acceleration, omega)
+
+    def iterate_prioritized(self, max_updates: int, tolerance: float = 1e-6) -> int:
+        """
+        Update players one at a time, always the one whose ratings are
+        furthest from optimal (Southwell scheduling).
+        Players are prioritized by the norm of the gradient of the log
+        likelihood with respect to their ratings. After each Newton update,
+        the gradients of the player's opponents are corrected and
+        reprioritized, so the work concentrates where ratings are still
+        moving, e.g. around newly added games.
+
+        Parameters
+        ----------
+        max_updates : int
+            Largest number of player updates performed by this call.
+
+        tolerance : float, default = 1e-6
+            Stop once no player's gradient norm exceeds this value.
+
+        Returns
+        -------
+        int
+            Number of player updates performed.
+        """
+        return self.core.iterate_prioritized(max_updates, tolerance)
+
+    def component_for_player(self, name: str) -> int:
+        """
+        Get the connected component of a player in the game graph.
+
+        Parameters
+        ----------
+        name : str
+            Name of the requested player.
+
+        Returns
+        -------
+        int
+            Component id, numbered in alphabetical order of the first player
+            name of each component, or -1 if the player does not exist.
+        """
+        return self.core.component_for_player(name)
+
+    def snapshot_reader(self) -> SnapshotReader:
+        """
+        Get a reader of the ratings that is safe to query from other threads
+        while this database iterates.
+        The first call starts publishing a snapshot of all ratings
+        after every round of iteration; later calls share the same snapshots.
+
+        Returns
+        -------
+        SnapshotReader
+            Reader of the latest published ratings.
+        """
+        return SnapshotReader(self.core.snapshot_reader())
+
+    def iterate(self, count: int, acceleration: str = "none", omega: float = 1.0):
         """
         Iterate the computation for a fixed number of rounds.
 
@@ -183,5 +540,17 @@ class Base:
         ----------
         count : int
             Number of rounds.
+
+        acceleration : str, {"none", "sor", "anderson"}, default = "none"
+            Convergence acceleration scheme.
+            "none" runs plain Newton sweeps over all players.
+            "sor" scales every Newton step by `omega` (successive over-relaxation);
+            values in (1, 2) usually help on weakly connected databases.
+            "anderson" extrapolates over the ratings of the last few sweeps
+            (Anderson mixing) and falls back to the plain sweep whenever
+            the extrapolated ratings decrease the log likelihood.
+
+        omega : float, default = 1.0
+            Relaxation factor of the Newton steps, used by "sor" and "anderson".
         """
-        self.core.iterate(count)
+        self.core.iterate(count, acceleration, omega)
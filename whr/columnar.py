@@ -0,0 +1,73 @@
+import mmap
+import struct
+from array import array
+
+MAGIC = b"WHRCOL01"
+FOOTER = struct.Struct("<5Q8s")
+
+
+def read_rating_columns(path: str) -> dict:
+    """
+    Read a rating history file written by `Base.export_ratings`.
+    Only the standard library is used; the file layout is documented
+    in the README, so tools such as numpy can memory-map the columns directly.
+
+    Parameters
+    ----------
+    path : str
+        Path of the exported file.
+
+    Returns
+    -------
+    dict
+        "names": list of player names, indexed by the "player" column;
+        "player": array('I') of player indices;
+        "time_step": array('i') of time steps;
+        "elo": array('d') of Elo ratings;
+        "stddev": array('d') of rating standard deviations.
+        Rows of the same player are contiguous and ordered by time step.
+    """
+    with open(path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+        if m[:8] != MAGIC or len(m) < FOOTER.size:
+            raise ValueError("Not a whr rating columns file: " + path)
+        (
+            dictionary_offset,
+            index_offset,
+            num_chunks,
+            num_rows,
+            num_players,
+            magic,
+        ) = FOOTER.unpack_from(m, len(m) - FOOTER.size)
+        if magic != MAGIC:
+            raise ValueError("Truncated whr rating columns file: " + path)
+
+        names = []
+        offset = dictionary_offset
+        for _ in range(num_players):
+            (length,) = struct.unpack_from("<I", m, offset)
+            names.append(m[offset + 4 : offset + 4 + length].decode("utf-8"))
+            offset += 4 + length
+
+        columns = {
+            "names": names,
+            "player": array("I"),
+            "time_step": array("i"),
+            "elo": array("d"),
+            "stddev": array("d"),
+        }
+        chunk_offsets = struct.unpack_from("<%dQ" % num_chunks, m, index_offset)
+        for offset in chunk_offsets:
+            (rows,) = struct.unpack_from("<Q", m, offset)
+            offset += 8
+            for name, item_size in [
+                ("player", 4),
+                ("time_step", 4),
+                ("elo", 8),
+                ("stddev", 8),
+            ]:
+                size = rows * item_size
+                columns[name].frombytes(m[offset : offset + size])
+                offset += (size + 7) // 8 * 8
+        if len(columns["player"]) != num_rows:
+            raise ValueError("Corrupt whr rating columns file: " + path)
+        return columns
@@ -0,0 +1,75 @@
+import math
+from typing import Union
+
+
+class SnapshotReader:
+    def __init__(self, core):
+        """
+        Read-only view of the latest ratings published by a `Base`.
+
+        The ratings are republished after every round of iteration,
+        and the iteration methods of `Base` release the GIL,
+        so other threads can query a reader while the ratings are computed.
+        Each query sees one complete round, never a partially updated one.
+        Use `Base.snapshot_reader` to create a reader.
+        """
+        self.core = core
+
+    def version(self) -> int:
+        """
+        Get the number of snapshots published so far.
+
+        Returns
+        -------
+        int
+            Version of the snapshot that queries currently read from.
+        """
+        return self.core.get_version()
+
+    def get_rating(
+        self, name: str, time_step: int, ignore_null_players: bool = True
+    ) -> Union[float, None]:
+        """
+        Get the rating of a particular player at a particular time step,
+        interpolated like `Evaluate.get_rating`.
+
+        Parameters
+        ----------
+        name : str
+            Name of the player.
+
+        time_step : int
+            Time step of the player.
+
+        ignore_null_players : bool, default = True
+            Ignore players not appearing in the snapshot.
+            If True, rating of null players will be set to None.
+            If False, rating of null players will be set to 0.
+
+        Returns
+        -------
+        float or None
+            Rating of the requested player at the requested time step.
+        """
+        ret = self.core.get_rating(name, time_step, ignore_null_players)
+        if not math.isfinite(ret):
+            return None
+        return ret
+
+    def ratings_for_player(self, name: str) -> list:
+        """
+        Get the published rating history of a player.
+
+        Parameters
+        ----------
+        name : str
+            Name of the requested player.
+
+        Returns
+        -------
+        list
+            The list of [time_step, elo, uncertainty] entries,
+            or an empty list if the player does not exist.
+            The uncertainties are only refreshed when an iteration call ends.
+        """
+        return self.core.ratings_for_player(name)
@@ -0,0 +1,74 @@
+import whr_core
+from .base import Base
+
+
+class Tournament:
+    def __init__(self, base: Base):
+        """
+        Monte Carlo simulator of tournaments between the players
+        of a trained model of Elo ratings.
+
+        Parameters
+        ----------
+        base : Base
+            Trained model of Elo ratings.
+            Later changes to the model are not seen by the simulator.
+        """
+        self.core = whr_core.Tournament(base.core)
+
+    def placement_probabilities(
+        self,
+        players: list,
+        time_step: int,
+        format: str = "round_robin",
+        simulations: int = 10000,
+        rounds: int = 0,
+        seed: int = 0,
+        threads: int = 0,
+    ) -> dict:
+        """
+        Simulate a tournament many times and count where each player finishes.
+        In every simulation, the rating of each player is sampled from
+        its posterior at the time step, and games are won or lost
+        according to the Elo model. Ties in the final standings are broken
+        at random.
+
+        Parameters
+        ----------
+        players : list
+            Names of the players, in seeding order.
+
+        time_step : int
+            Time step at which the ratings are taken.
+
+        format : str, default = "round_robin"
+            "round_robin": every player meets every other one `rounds` times.
+            "swiss": players with similar scores are paired for `rounds`
+            rounds, avoiding rematches; ties are broken by Buchholz score.
+            "single_elimination": a seeded knockout bracket, with byes
+            for the top seeds when the field is not a power of two.
+
+        simulations : int, default = 10000
+            Number of simulated tournaments.
+
+        rounds : int, default = 0
+            Number of round robin cycles or Swiss rounds.
+            If 0, one cycle, or enough Swiss rounds to single out a winner.
+
+        seed : int, default = 0
+            Seed of the random streams. Every simulation has its own stream,
+            so the result does not depend on the number of threads.
+
+        threads : int, default = 0
+            Number of threads. If 0, all hardware threads are used.
+
+        Returns
+        -------
+        dict
+            Maps each player to the list of probabilities of finishing
+            in each place, the first one being the win probability.
+        """
+        probabilities = self.core.placement_probabilities(
+            players, time_step, format, simulations, rounds, seed, threads
+        )
+        return dict(zip(players, probabilities))